@@ -5,11 +5,38 @@
 #include <math.h>
 #include <algorithm>
 #include <iostream>
+#include <cstdint>
+#include <bit>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <deque>
+#include <array>
+#include <queue>
+#include <climits>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <coroutine>
+#include <utility>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 #include "../external/json.hpp"
 
 bool DEBUG_MODE = false;
+bool SHADER_TILEMAP = true;         // F4 switches finite maps between TilemapRenderer and per-tile draws
+bool DYNAMIC_RESOLUTION = true;     // F6, off goes back to the fixed GAME_WIDTH x GAME_HEIGHT target
 
 const std::string RESOURCE_PATH = "./resources/";
+const std::string DEFAULT_LANGUAGE = "es";
 
 const std::string LAYER_ALWAYSABOVE = "AlwaysAbove";
 const std::string LAYER_DRAWABLES = "Drawables";
@@ -18,89 +45,953 @@ const std::string LAYER_TRANSITIONS = "Transitions";
 const std::string LAYER_SPAWNPOINTS = "SpawnPoints";
 const std::string LAYER_DIALOGUES = "Dialogues";
 const std::string LAYER_EVENTS = "Events";
+const std::string LAYER_LIGHTS = "Lights";
+const std::string LAYER_PARTICLES = "Particles";
+
+// Names coming from the map files (layers, dialogues, NPCs, events, maps) are interned once at load,
+// everything after that compares and hashes 32 bit ids instead of strings
+using NameId = uint32_t;
+const NameId NO_NAME = 0;
+
+struct NameTable {
+    std::unordered_map<std::string, NameId> ids;
+    std::deque<std::string> names;  // deque so references from nameOf stay valid while interning
+
+    NameTable() {
+        names.push_back("");
+        ids[""] = NO_NAME;
+    }
+
+    NameId intern(const std::string& name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) return it->second;
+        NameId id = (NameId)names.size();
+        names.push_back(name);
+        ids.emplace(name, id);
+        return id;
+    }
+};
+
+NameTable& nameTable() {
+    static NameTable table;         // Function static so globals below can intern during static init
+    return table;
+}
+
+NameId intern(const std::string& name) {
+    return nameTable().intern(name);
+}
+
+const std::string& nameOf(NameId id) {
+    return nameTable().names[id];
+}
+
+const NameId NAME_ALWAYSABOVE = intern(LAYER_ALWAYSABOVE);
+const NameId NAME_DRAWABLES = intern(LAYER_DRAWABLES);
 
 const int tileSize = 32;
 
 const int GAME_WIDTH  = 1280;
 const int GAME_HEIGHT = 720;
+const int DEFAULT_FPS = 60;                 // Frame cap when the monitor doesn't report its refresh rate
+const int DEFAULT_TICK_RATE = 60;           // Rewind snapshots per second
 
 const int DOWN = 10;
 const int UP = 8;
 const int RIGHT = 11;
 const int LEFT = 9;
 
+enum ClipId { CLIP_IDLE, CLIP_WALK, CLIP_RUN, CLIP_CAST, CLIP_COUNT };
+
+// An animation spread over four consecutive rows, one per facing in the order up, left, down, right
+struct AnimationClip {
+    int row;
+    int frames;
+    float frameTime;        // Seconds per frame
+};
+
+// Universal LPC character sheets, 64 px frames on a 13 x 54 grid
+struct LpcLayout {
+    static constexpr int columns = 13;
+    static constexpr int rows = 54;
+    static constexpr int frameSize = 64;
+    static constexpr AnimationClip clips[CLIP_COUNT] = {
+        { 22, 2, 0.50f },   // CLIP_IDLE
+        { 8,  9, 0.10f },   // CLIP_WALK, frame 0 is the standing pose
+        { 38, 8, 0.08f },   // CLIP_RUN
+        { 0,  7, 0.10f },   // CLIP_CAST
+    };
+};
+
+// Frame rects and clip lookups of a sheet layout, all built at compile time. Drawing a character is
+// cells[clip][facing][frame] into the atlas registered with the sheet's rects
+template <typename Layout>
+struct SpriteSheet {
+    static constexpr int columns = Layout::columns;
+    static constexpr int rows = Layout::rows;
+    static constexpr int frameSize = Layout::frameSize;
+
+    static constexpr std::array<Rectangle, columns * rows> rects = [] {
+        std::array<Rectangle, columns * rows> r{};
+        for (int row = 0; row < rows; row++)
+            for (int col = 0; col < columns; col++)
+                r[row * columns + col] = { (float)(col * frameSize), (float)(row * frameSize), (float)frameSize, (float)frameSize };
+        return r;
+    }();
+
+    // Past the end of a clip repeats its last frame, so a stale frame number never reads another animation
+    static constexpr auto cells = [] {
+        std::array<std::array<std::array<uint16_t, columns>, 4>, CLIP_COUNT> t{};
+        for (int clip = 0; clip < CLIP_COUNT; clip++)
+            for (int facing = 0; facing < 4; facing++)
+                for (int frame = 0; frame < columns; frame++)
+                    t[clip][facing][frame] = (Layout::clips[clip].row + facing) * columns
+                                           + std::min(frame, Layout::clips[clip].frames - 1);
+        return t;
+    }();
+
+    static constexpr const AnimationClip& clip(int id) { return Layout::clips[id]; }
+
+    // Direction constants are the walk rows, so the facing is the offset from UP
+    static constexpr int cell(int clip, int direction, int frame) { return cells[clip][direction - UP][frame]; }
+};
+
+using LpcSheet = SpriteSheet<LpcLayout>;
+
+static_assert(LpcSheet::clip(CLIP_WALK).row == UP && LpcSheet::clip(CLIP_WALK).row + 3 == RIGHT,
+              "direction constants double as LPC walk rows");
+static_assert(LpcSheet::cell(CLIP_RUN, LEFT, 3) == 39 * 13 + 3);
+
 enum GameState {
-    STATE_NORMAL, STATE_TRANSITION, STATE_DIALOGUE, STATE_EVENT
+    STATE_NORMAL, STATE_TRANSITION, STATE_DIALOGUE, STATE_EVENT, STATE_REWIND
 };
 
 GameState gameState = STATE_NORMAL;
 
 using json = nlohmann::json;
 
+// Memory accounting. In MEMORY_TRACKING builds (make dev) every C++ allocation carries a small header with its
+// size and the category that was active on its thread when it was made, so frees are charged back to the right
+// one. Release builds keep the default allocator and only count GPU memory. raylib's own mallocs (image pixels
+// while loading) aren't seen, GPU memory is counted separately per texture
+enum MemoryCategory {
+    MEM_GENERAL, MEM_LEVEL, MEM_JSON, MEM_NAVIGATION, MEM_STREAMING, MEM_DIALOGUE, MEM_SCRIPTS, MEM_REWIND,
+    MEM_CATEGORY_COUNT
+};
+
+enum VramCategory {
+    VRAM_TILESETS, VRAM_CHARACTERS, VRAM_TILEMAP, VRAM_LIGHTING, VRAM_PARALLAX, VRAM_PARTICLES, VRAM_TARGETS, VRAM_UI,
+    VRAM_CATEGORY_COUNT
+};
+
+const char* const MEMORY_NAMES[] = { "general", "level", "json", "navigation", "streaming", "dialogue", "scripts", "rewind" };
+const char* const VRAM_NAMES[] = { "tilesets", "characters", "tilemap", "lighting", "parallax", "particles", "targets", "ui" };
+
+struct MemoryCounter {
+    std::atomic<int64_t> current{0}, peak{0};
+
+    void add(int64_t bytes) {
+        int64_t now = current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        int64_t top = peak.load(std::memory_order_relaxed);
+        while (now > top && !peak.compare_exchange_weak(top, now, std::memory_order_relaxed)) { }
+    }
+};
+
+constinit MemoryCounter memoryCounters[MEM_CATEGORY_COUNT];
+constinit MemoryCounter memoryTotal;
+constinit MemoryCounter memoryWindow;       // Same as the total, its peak is reset when a map starts loading
+constinit thread_local int memoryCategory = MEM_GENERAL;
+
+#ifdef MEMORY_TRACKING
+constexpr bool MEMORY_TRACKED = true;
+
+struct AllocationHeader {
+    uint64_t size;
+    uint32_t category;
+    uint32_t offset;                        // From the malloc'd block to the returned pointer
+};
+
+void* trackedAllocate(size_t size, size_t alignment) {
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    unsigned char* raw = (unsigned char*)malloc(size + sizeof(AllocationHeader) + alignment - alignof(std::max_align_t));
+    if (!raw) return nullptr;
+    uintptr_t p = ((uintptr_t)raw + sizeof(AllocationHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    AllocationHeader* h = (AllocationHeader*)p - 1;
+    h->size = size;
+    h->category = memoryCategory;
+    h->offset = (uint32_t)(p - (uintptr_t)raw);
+    memoryCounters[h->category].add((int64_t)size);
+    memoryTotal.add((int64_t)size);
+    memoryWindow.add((int64_t)size);
+    return (void*)p;
+}
+
+void trackedFree(void* p) {
+    if (!p) return;
+    AllocationHeader* h = (AllocationHeader*)p - 1;
+    memoryCounters[h->category].add(-(int64_t)h->size);
+    memoryTotal.add(-(int64_t)h->size);
+    memoryWindow.add(-(int64_t)h->size);
+    free((unsigned char*)p - h->offset);
+}
+
+void* operator new(size_t size) {
+    if (void* p = trackedAllocate(size, alignof(std::max_align_t))) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, std::align_val_t a) {
+    if (void* p = trackedAllocate(size, (size_t)a)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size, std::align_val_t a) { return operator new(size, a); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return trackedAllocate(size, alignof(std::max_align_t)); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return trackedAllocate(size, alignof(std::max_align_t)); }
+void operator delete(void* p) noexcept { trackedFree(p); }
+void operator delete[](void* p) noexcept { trackedFree(p); }
+void operator delete(void* p, size_t) noexcept { trackedFree(p); }
+void operator delete[](void* p, size_t) noexcept { trackedFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { trackedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { trackedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { trackedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { trackedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { trackedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { trackedFree(p); }
+#else
+constexpr bool MEMORY_TRACKED = false;      // CPU counters stay at 0
+#endif
+
+// Allocations on this thread go to the category until the end of the block
+struct MemoryScope {
+    int previous;
+    explicit MemoryScope(int category) : previous(memoryCategory) { memoryCategory = category; }
+    ~MemoryScope() { memoryCategory = previous; }
+};
+
+// GPU side, bytes of every live texture by id. Render textures add their depth buffer
+struct VramAccounting {
+    struct Entry {
+        int64_t bytes;
+        int category;
+    };
+
+    std::unordered_map<unsigned int, Entry> textures;
+    int64_t current[VRAM_CATEGORY_COUNT] = {};
+    int64_t peak[VRAM_CATEGORY_COUNT] = {};
+    int64_t total = 0, totalPeak = 0;
+
+    void add(unsigned int id, int64_t bytes, int category) {
+        if (id == 0) return;
+        remove(id);
+        textures[id] = { bytes, category };
+        current[category] += bytes;
+        peak[category] = std::max(peak[category], current[category]);
+        total += bytes;
+        totalPeak = std::max(totalPeak, total);
+    }
+
+    void remove(unsigned int id) {
+        auto it = textures.find(id);
+        if (it == textures.end()) return;
+        current[it->second.category] -= it->second.bytes;
+        total -= it->second.bytes;
+        textures.erase(it);
+    }
+};
+
+VramAccounting vram;
+
+Texture2D loadTexture(const char* path, int category) {
+    Texture2D t = LoadTexture(path);
+    vram.add(t.id, GetPixelDataSize(t.width, t.height, t.format), category);
+    return t;
+}
+
+Texture2D loadTextureFromImage(Image image, int category) {
+    Texture2D t = LoadTextureFromImage(image);
+    vram.add(t.id, GetPixelDataSize(t.width, t.height, t.format), category);
+    return t;
+}
+
+RenderTexture2D loadRenderTexture(int width, int height, int category) {
+    RenderTexture2D t = LoadRenderTexture(width, height);
+    vram.add(t.texture.id, GetPixelDataSize(width, height, t.texture.format) + (int64_t)width * height * 4, category);
+    return t;
+}
+
+void unloadTexture(Texture2D t) {
+    vram.remove(t.id);
+    UnloadTexture(t);
+}
+
+void unloadRenderTexture(RenderTexture2D t) {
+    vram.remove(t.texture.id);
+    UnloadRenderTexture(t);
+}
+
+// Budgets in bytes, 0 is unlimited. Set from config.json, checked after map loads and once a second
+struct MemoryBudgets {
+    int64_t cpu[MEM_CATEGORY_COUNT] = {};
+    int64_t gpu[VRAM_CATEGORY_COUNT] = {};
+    int64_t cpuTotal = 0, gpuTotal = 0;
+    bool fail = false;                      // Development builds stop at the first overrun instead of warning
+    uint32_t warned = 0;                    // One warning per budget until it's back under
+
+    bool check(int bit, const char* kind, const char* name, int64_t used, int64_t budget) {
+        if (budget <= 0 || used <= budget) {
+            warned &= ~(1u << bit);
+            return true;
+        }
+        if (fail)
+            TraceLog(LOG_FATAL, "MEMORY: %s %s uses %.2f MiB, budget %.2f MiB", kind, name, used / 1048576.0, budget / 1048576.0);
+        else if (!(warned & (1u << bit)))
+            TraceLog(LOG_WARNING, "MEMORY: %s %s uses %.2f MiB, budget %.2f MiB", kind, name, used / 1048576.0, budget / 1048576.0);
+        warned |= 1u << bit;
+        return false;
+    }
+
+    bool checkAll() {
+        bool ok = true;
+        if (MEMORY_TRACKED) {
+            for (int c = 0; c < MEM_CATEGORY_COUNT; c++)
+                ok &= check(c, "CPU", MEMORY_NAMES[c], memoryCounters[c].current.load(std::memory_order_relaxed), cpu[c]);
+            ok &= check(MEM_CATEGORY_COUNT, "CPU", "total", memoryTotal.current.load(std::memory_order_relaxed), cpuTotal);
+        }
+        for (int c = 0; c < VRAM_CATEGORY_COUNT; c++)
+            ok &= check(MEM_CATEGORY_COUNT + 1 + c, "VRAM", VRAM_NAMES[c], vram.current[c], gpu[c]);
+        ok &= check(MEM_CATEGORY_COUNT + 1 + VRAM_CATEGORY_COUNT, "VRAM", "total", vram.total, gpuTotal);
+        return ok;
+    }
+
+    // { "cpu": { "level": 32, "total": 256 }, "vram": { "tilesets": 64 }, "fail": true }, sizes in MiB
+    void load(const json& j) {
+        auto read = [](const json& group, const char* const* names, int count, int64_t* out, int64_t& total) {
+            if (!group.is_object()) return;
+            for (auto& [key, value] : group.items()) {
+                if (!value.is_number()) continue;
+                int64_t bytes = (int64_t)(value.get<double>() * 1048576.0);
+                if (key == "total") {
+                    total = bytes;
+                    continue;
+                }
+                int c = (int)(std::find(names, names + count, key) - names);
+                if (c < count) out[c] = bytes;
+                else TraceLog(LOG_WARNING, "CONFIG: Unknown memory budget %s", key.c_str());
+            }
+        };
+        read(j.value("cpu", json::object()), MEMORY_NAMES, MEM_CATEGORY_COUNT, cpu, cpuTotal);
+        read(j.value("vram", json::object()), VRAM_NAMES, VRAM_CATEGORY_COUNT, gpu, gpuTotal);
+        fail = j.value("fail", false);
+        if (!MEMORY_TRACKED && j.contains("cpu"))
+            TraceLog(LOG_WARNING, "CONFIG: CPU memory budgets need a MEMORY_TRACKING build, ignored");
+    }
+};
+
+MemoryBudgets memoryBudgets;
+
+// What a map costs once loaded, and the highest total reached while loading it
+struct MapMemory {
+    std::string map;
+    int64_t cpu[MEM_CATEGORY_COUNT];
+    int64_t vram[VRAM_CATEGORY_COUNT];
+    int64_t arenaUsed;
+    int64_t loadPeak;
+};
+
+std::vector<MapMemory> mapMemory;           // Latest load of every map seen this run
+
+std::string memoryReport() {
+    std::string out;
+    if (MEMORY_TRACKED) {
+        out += TextFormat("%-12s %10s %10s   (MiB)\n", "CPU", "current", "peak");
+        for (int c = 0; c < MEM_CATEGORY_COUNT; c++)
+            out += TextFormat("%-12s %10.2f %10.2f\n", MEMORY_NAMES[c], memoryCounters[c].current / 1048576.0, memoryCounters[c].peak / 1048576.0);
+        out += TextFormat("%-12s %10.2f %10.2f\n\n", "total", memoryTotal.current / 1048576.0, memoryTotal.peak / 1048576.0);
+    }
+    else out += "CPU not tracked, build with MEMORY_TRACKING (make dev)\n\n";
+    out += TextFormat("%-12s %10s %10s   (MiB)\n", "VRAM", "current", "peak");
+    for (int c = 0; c < VRAM_CATEGORY_COUNT; c++)
+        out += TextFormat("%-12s %10.2f %10.2f\n", VRAM_NAMES[c], vram.current[c] / 1048576.0, vram.peak[c] / 1048576.0);
+    out += TextFormat("%-12s %10.2f %10.2f\n", "total", vram.total / 1048576.0, vram.totalPeak / 1048576.0);
+    if (!mapMemory.empty())
+        out += "\n";
+    for (const MapMemory& m : mapMemory) {
+        int64_t cpu = 0, gpu = 0;
+        for (int64_t b : m.cpu) cpu += b;
+        for (int64_t b : m.vram) gpu += b;
+        if (MEMORY_TRACKED)
+            out += TextFormat("Map %s: CPU %.2f MiB (level %.2f, arena %.2f), load peak %.2f MiB, ", m.map.c_str(), cpu / 1048576.0,
+                m.cpu[MEM_LEVEL] / 1048576.0, m.arenaUsed / 1048576.0, m.loadPeak / 1048576.0);
+        else out += TextFormat("Map %s: arena %.2f MiB, ", m.map.c_str(), m.arenaUsed / 1048576.0);
+        out += TextFormat("VRAM %.2f MiB (tilesets %.2f, characters %.2f)\n", gpu / 1048576.0,
+            m.vram[VRAM_TILESETS] / 1048576.0, m.vram[VRAM_CHARACTERS] / 1048576.0);
+    }
+    return out;
+}
+
+bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Moves a finished tmp file over path, so a crash mid-write never leaves a half written file behind
+bool replaceFile(const std::string& tmpPath, const std::string& path) {
+    if (std::rename(tmpPath.c_str(), path.c_str()) == 0) return true;
+    std::remove(path.c_str());                      // Windows won't rename over an existing file
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+// Count followed by the raw elements, for the binary caches and saves (plain structs only)
+template <typename T>
+void writeArray(std::ofstream& f, const std::vector<T>& v) {
+    uint32_t count = v.size();
+    f.write((const char*)&count, 4);
+    f.write((const char*)v.data(), count * sizeof(T));
+}
+
+// The count is checked against what's left of the file first, a corrupt one can't ask for gigabytes
+template <typename T>
+bool readArray(std::ifstream& f, std::vector<T>& v) {
+    uint32_t count = 0;
+    f.read((char*)&count, 4);
+    if (!f) return false;
+    std::streampos here = f.tellg();
+    f.seekg(0, std::ios::end);
+    std::streamoff left = f.tellg() - here;
+    f.seekg(here);
+    if (!f || (uint64_t)count * sizeof(T) > (uint64_t)left) return false;
+    v.resize(count);
+    f.read((char*)v.data(), count * sizeof(T));
+    return (bool)f;
+}
+
 json loadJson(const std::string& path) {
+    MemoryScope scope(MEM_JSON);
     std::ifstream f(path);
     json j;
     f >> j;
     return j;
 }
 
+// Same as loadJson but the values of every `key` are dropped while parsing instead of being built into the DOM
+json loadJsonSkipping(const std::string& path, const std::string& key) {
+    MemoryScope scope(MEM_JSON);
+    std::ifstream f(path);
+    return json::parse(f, [&key](int, json::parse_event_t event, json& parsed) {
+        return !(event == json::parse_event_t::key && parsed == key);
+    });
+}
+
+// Skips the zlib or gzip wrapper, raylib only inflates raw DEFLATE streams. Returns the offset of the stream or -1
+int deflateStreamOffset(const unsigned char* bytes, int size, const std::string& compression) {
+    if (compression == "zlib") {
+        if (size < 2 || (bytes[0] & 0x0F) != 8 || ((bytes[0] << 8) | bytes[1]) % 31 != 0) return -1;
+        return (bytes[1] & 0x20) ? 6 : 2;           // FDICT adds a 4 byte dictionary id
+    }
+    if (compression == "gzip") {
+        if (size < 10 || bytes[0] != 0x1F || bytes[1] != 0x8B || bytes[2] != 8) return -1;
+        int flags = bytes[3];
+        int offset = 10;
+        if (flags & 0x04) {                                                             // FEXTRA
+            if (offset + 2 > size) return -1;
+            offset += 2 + (bytes[offset] | (bytes[offset + 1] << 8));
+        }
+        if (flags & 0x08) while (offset < size && bytes[offset++] != 0) { }             // FNAME
+        if (flags & 0x10) while (offset < size && bytes[offset++] != 0) { }             // FCOMMENT
+        if (flags & 0x02) offset += 2;                                                  // FHCRC
+        return (offset < size) ? offset : -1;
+    }
+    return -1;
+}
+
+// Tile data of a layer or of an infinite map chunk. Plain json arrays, or Tiled's base64 with optional zlib/gzip,
+// decoded straight into the gid buffer. Encoding and compression are layer properties, also for chunks
+std::vector<int> readTileData(const json& node, const std::string& encoding, const std::string& compression, int count) {
+    const json& jsonData = node["data"];
+    std::vector<int> data(count, 0);
+
+    if (!jsonData.is_string()) {
+        for (int i = 0; i < count && i < (int)jsonData.size(); i++)
+            data[i] = jsonData[i].get<int>();
+        return data;
+    }
+
+    if (encoding != "base64") {
+        TraceLog(LOG_WARNING, "MAP: Unsupported tile data encoding '%s'", encoding.c_str());
+        return data;
+    }
+    if (compression == "zstd") {
+        TraceLog(LOG_WARNING, "MAP: zstd tile data is not supported, export with zlib or gzip");
+        return data;
+    }
+
+    int size = 0;
+    unsigned char* bytes = DecodeDataBase64(jsonData.get_ref<const std::string&>().c_str(), &size);
+    if (!bytes) return data;
+
+    unsigned char* raw = bytes;
+    int rawSize = size;
+    unsigned char* inflated = nullptr;
+    if (!compression.empty()) {
+        int offset = deflateStreamOffset(bytes, size, compression);
+        if (offset >= 0)
+            inflated = DecompressData(bytes + offset, size - offset, &rawSize);
+        if (!inflated) {
+            TraceLog(LOG_WARNING, "MAP: Could not decompress %s tile data", compression.c_str());
+            MemFree(bytes);
+            return data;
+        }
+        raw = inflated;
+    }
+
+    // Gids are little endian uint32, same as every platform we build for
+    memcpy(data.data(), raw, std::min(rawSize, count * 4) / 4 * 4);
+
+    if (inflated) MemFree(inflated);
+    MemFree(bytes);
+    return data;
+}
+
+// Load time description of a static drawable, packed into a RenderItem once its sortY is final
 struct Drawable {
-    Rectangle src;
     Rectangle dst;
-    Texture2D* texture;
     float sortY;
+    int atlas, frame;
 
     int x, y;
-    std::string layer;
+    NameId layer;
+};
+
+// What the Y-sorted pass walks every frame. Expanded to raylib rects only when submitted
+struct RenderItem {
+    uint64_t key;           // Quantized sortY in the high half, submission order in the low half
+    int16_t x, y;           // Destination top-left in world pixels relative to Map::renderOrigin
+    uint16_t atlas;         // Map::atlases
+    uint16_t frame;         // SpriteAtlas::frames
+};
+static_assert(sizeof(RenderItem) == 16, "RenderItem should stay 16 bytes");
+
+uint64_t renderKey(float sortY, uint32_t order) {
+    // 1/16 px precision, sign bit flipped so negative positions still sort before positive ones
+    uint32_t y = (uint32_t)(int32_t)floorf(sortY * 16.0f) ^ 0x80000000u;
+    return ((uint64_t)y << 32) | order;
+}
+
+struct AtlasFrame {
+    Rectangle src;
+    float width, height;    // Destination size
+};
+
+// Source rects of one texture, RenderItem::frame indexes into them
+struct SpriteAtlas {
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    Texture2D* texture;
+    std::pmr::vector<AtlasFrame> frames;
+
+    SpriteAtlas() = default;
+    explicit SpriteAtlas(const allocator_type& a) : frames(a) { }
+    SpriteAtlas(const SpriteAtlas& o, const allocator_type& a) : texture(o.texture), frames(o.frames, a) { }
+    SpriteAtlas(SpriteAtlas&& o, const allocator_type& a) : texture(o.texture), frames(std::move(o.frames), a) { }
 };
 
 struct Transition {
     Rectangle trigger;
-    std::string map, spawnName;
+    NameId map, spawnName;
 };
 
 struct NPC;
 
 enum EventActionType {
-    ACTION_MOVE_NPC, ACTION_MOVE_PLAYER, ACTION_MOVE_CAMERA, ACTION_DIALOGUE, ACTION_GROUP
+    ACTION_MOVE_NPC, ACTION_MOVE_PLAYER, ACTION_MOVE_CAMERA, ACTION_DIALOGUE, ACTION_GROUP, ACTION_WAIT, ACTION_PATH_NPC
 };
 
+// Parsed from the events json, runtime state lives in the coroutine running the action
 struct EventAction {
-    EventActionType type;
-    bool started = false;
-    float target;
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    EventActionType type = ACTION_WAIT;
 
     // Moves
-    NPC* npc;        // Only in ACTION_MOVE_NPC
-    int tiles;
-    int direction;
-    bool follow;     // Only in ACTION_MOVE_NPC and ACTION_MOVE_PLAYER ---- Camera follow
+    NPC* npc = nullptr;     // Only in ACTION_MOVE_NPC and ACTION_PATH_NPC
+    int tiles = 0;
+    int direction = DOWN;
+    bool follow = false;    // Only in ACTION_MOVE_NPC, ACTION_PATH_NPC and ACTION_MOVE_PLAYER ---- Camera follow
+    int targetX = 0, targetY = 0;       // Only in ACTION_PATH_NPC, in tiles
 
     // Dialogues
-    std::string dialogue;   // Only in ACTION_DIALOGUE
+    NameId dialogue = NO_NAME;  // Only in ACTION_DIALOGUE
 
     // Groups
-    std::vector<EventAction> subactions; // Only in ACTION_GROUP
-    bool finished = false;               // Only in ACTION_GROUP
+    std::pmr::vector<EventAction> subactions; // Only in ACTION_GROUP
 
     // Camera
-    float speed;                         // Only in ACTION_MOVE_CAMERA
+    float speed = 0.0f;                  // Only in ACTION_MOVE_CAMERA
+
+    // Wait
+    float seconds = 0.0f;                // Only in ACTION_WAIT
+
+    EventAction() = default;
+    explicit EventAction(const allocator_type& a) : subactions(a) { }
+    EventAction(const EventAction& o, const allocator_type& a)
+        : type(o.type), npc(o.npc), tiles(o.tiles), direction(o.direction), follow(o.follow), targetX(o.targetX), targetY(o.targetY),
+          dialogue(o.dialogue), subactions(o.subactions, a), speed(o.speed), seconds(o.seconds) { }
+    EventAction(EventAction&& o, const allocator_type& a)
+        : type(o.type), npc(o.npc), tiles(o.tiles), direction(o.direction), follow(o.follow), targetX(o.targetX), targetY(o.targetY),
+          dialogue(o.dialogue), subactions(std::move(o.subactions), a), speed(o.speed), seconds(o.seconds) { }
 };
 
 struct Event {
-    std::string name;
-    std::vector<EventAction> actions;
-    int eventIndex = 0;
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    NameId name;
+    NameId flag;                            // "<map>/<event>" in the world flags, set once it has run
+    std::pmr::vector<EventAction> actions;
     bool triggered = false;
+
+    Event() = default;
+    explicit Event(const allocator_type& a) : actions(a) { }
+    Event(const Event& o, const allocator_type& a) : name(o.name), flag(o.flag), actions(o.actions, a), triggered(o.triggered) { }
+    Event(Event&& o, const allocator_type& a) : name(o.name), flag(o.flag), actions(std::move(o.actions), a), triggered(o.triggered) { }
+};
+
+// One sentence of the dialogue table. Text is stored once in DialogueDB and never copied out of it
+struct DialogueLine {
+    uint32_t speaker;           // DialogueDB::text offset, NUL terminated UTF-8
+    uint32_t msg;               // DialogueDB::text offset, NUL terminated UTF-8
+    uint32_t codepoints;        // DialogueDB::codepoints offset of msg, what the typewriter draws
+    uint32_t codepointCount;
 };
 
 struct Dialogue {
-    std::string name;
-    std::vector<std::string> speaker, msg;
+    NameId map, name;           // Names are only unique inside a map
+    uint32_t firstLine, lineCount;
+};
+
+const uint32_t DIALOGUEDB_MAGIC = 0x4C444945;      // "EIDL"
+const uint32_t DIALOGUEDB_VERSION = 1;
+
+// Every map's dialogues for one language, built from the <map>_dialogues json files into dialogues_<lang>.bin.
+// The binary is rebuilt whenever a source json is newer than it
+struct DialogueDB {
+    std::string language;
+    std::vector<char> text;
+    std::vector<int> codepoints;
+    std::vector<DialogueLine> lines;
+    std::vector<Dialogue> dialogues;
+    std::vector<uint32_t> names;                    // Text offsets of map and dialogue name, two per dialogue
+    std::unordered_map<uint64_t, int> index;
+
+    static uint64_t key(NameId map, NameId name) {
+        return ((uint64_t)map << 32) | name;
+    }
+
+    // <map>_dialogues.json is the default language, translations are <map>_dialogues_<lang>.json
+    static std::string sourceSuffix(const std::string& lang) {
+        return (lang == DEFAULT_LANGUAGE) ? "_dialogues.json" : "_dialogues_" + lang + ".json";
+    }
+
+    void load(const std::string& lang, bool rebuild = false) {
+        MemoryScope scope(MEM_DIALOGUE);
+        language = lang;
+        std::string suffix = sourceSuffix(lang);
+        std::vector<std::string> sources;
+        long modTime = 0;
+        FilePathList files = LoadDirectoryFilesEx(RESOURCE_PATH.c_str(), ".json", false);
+        for (unsigned int i = 0; i < files.count; i++) {
+            std::string file = GetFileName(files.paths[i]);
+            if (file.size() == suffix.size() || !endsWith(file, suffix)) continue;
+            sources.push_back(file);
+            modTime = std::max(modTime, GetFileModTime(files.paths[i]));
+        }
+        UnloadDirectoryFiles(files);
+        std::sort(sources.begin(), sources.end());
+
+        std::string binPath = RESOURCE_PATH + "dialogues_" + lang + ".bin";
+        if (rebuild || !read(binPath, modTime, sources.size())) {
+            build(sources, suffix);
+            write(binPath, modTime, sources.size());
+        }
+
+        index.clear();
+        for (size_t i = 0; i < dialogues.size(); i++) {
+            dialogues[i].map = intern(&text[names[i * 2]]);
+            dialogues[i].name = intern(&text[names[i * 2 + 1]]);
+            index[key(dialogues[i].map, dialogues[i].name)] = i;
+        }
+    }
+
+    uint32_t addText(const std::string& str) {
+        uint32_t offset = text.size();
+        text.insert(text.end(), str.begin(), str.end());
+        text.push_back('\0');
+        return offset;
+    }
+
+    void build(const std::vector<std::string>& sources, const std::string& suffix) {
+        text.clear();
+        codepoints.clear();
+        lines.clear();
+        dialogues.clear();
+        names.clear();
+
+        for (const std::string& file : sources) {
+            json j = loadJson(RESOURCE_PATH + file);
+            uint32_t mapText = addText(file.substr(0, file.size() - suffix.size()));
+            for (json& d : j["dialogues"]) {
+                Dialogue dia = { NO_NAME, NO_NAME, (uint32_t)lines.size(), 0 };
+                names.push_back(mapText);
+                names.push_back(addText(d["name"].get<std::string>()));
+                for (json& s : d["sentences"]) {
+                    DialogueLine line;
+                    line.speaker = addText(s["speaker"].get<std::string>());
+                    line.msg = addText(s["msg"].get<std::string>());
+                    int count = 0;
+                    int* cps = LoadCodepoints(&text[line.msg], &count);
+                    line.codepoints = codepoints.size();
+                    line.codepointCount = count;
+                    codepoints.insert(codepoints.end(), cps, cps + count);
+                    UnloadCodepoints(cps);
+                    lines.push_back(line);
+                    dia.lineCount++;
+                }
+                dialogues.push_back(dia);
+            }
+        }
+    }
+
+    void write(const std::string& binPath, long sourceModTime, uint32_t sourceCount) {
+        std::string tmpPath = binPath + ".tmp";
+        {
+            std::ofstream f(tmpPath, std::ios::binary);
+            int64_t modTime = sourceModTime;
+            f.write((const char*)&DIALOGUEDB_MAGIC, 4);
+            f.write((const char*)&DIALOGUEDB_VERSION, 4);
+            f.write((const char*)&modTime, 8);
+            f.write((const char*)&sourceCount, 4);
+            writeArray(f, text);
+            writeArray(f, codepoints);
+            writeArray(f, lines);
+            writeArray(f, dialogues);               // Map and name ids are runtime only, names are interned again from text
+            writeArray(f, names);
+            if (!f) {
+                TraceLog(LOG_WARNING, "DIALOGUE: Could not write %s", tmpPath.c_str());
+                return;
+            }
+        }
+        if (!replaceFile(tmpPath, binPath)) TraceLog(LOG_WARNING, "DIALOGUE: Could not replace %s", binPath.c_str());
+    }
+
+    bool read(const std::string& binPath, long sourceModTime, uint32_t sourceCount) {
+        std::ifstream f(binPath, std::ios::binary);
+        if (!f) return false;
+        uint32_t magic = 0, version = 0, count = 0;
+        int64_t modTime = 0;
+        f.read((char*)&magic, 4);
+        f.read((char*)&version, 4);
+        f.read((char*)&modTime, 8);
+        f.read((char*)&count, 4);
+        if (!f || magic != DIALOGUEDB_MAGIC || version != DIALOGUEDB_VERSION || modTime != sourceModTime || count != sourceCount)
+            return false;
+        if (!readArray(f, text) || !readArray(f, codepoints) || !readArray(f, lines)
+            || !readArray(f, dialogues) || !readArray(f, names) || names.size() != dialogues.size() * 2)
+            return false;
+
+        // Every offset line(), speaker() and msgCodepoints() will index with, a bad cache is just rebuilt
+        if (text.empty() || text.back() != '\0') return false;
+        for (const DialogueLine& l : lines)
+            if (l.speaker >= text.size() || l.msg >= text.size()
+                || (uint64_t)l.codepoints + l.codepointCount > codepoints.size()) return false;
+        for (const Dialogue& d : dialogues)
+            if ((uint64_t)d.firstLine + d.lineCount > lines.size()) return false;
+        for (uint32_t offset : names)
+            if (offset >= text.size()) return false;
+        return true;
+    }
+
+    const Dialogue* find(NameId map, NameId name) const {
+        auto it = index.find(key(map, name));
+        return (it != index.end()) ? &dialogues[it->second] : nullptr;
+    }
+
+    const DialogueLine& line(const Dialogue* d, int i) const { return lines[d->firstLine + i]; }
+    const char* speaker(const DialogueLine& l) const { return &text[l.speaker]; }
+    const int* msgCodepoints(const DialogueLine& l) const { return &codepoints[l.codepoints]; }
+};
+
+DialogueDB dialogueDB;
+
+const std::string QUICKSAVE_PATH = "./quicksave.sav";
+const std::string AUTOSAVE_PATH = "./autosave.sav";
+const uint32_t SAVE_MAGIC = 0x56534945;            // "EISV"
+const uint32_t SAVE_VERSION = 1;
+
+// Name fields are slots in WorldState::nameOffsets, NameIds don't survive a restart
+struct SavedPlayer {
+    uint32_t map;
+    float x, y;
+    int32_t direction;
+};
+
+struct SavedFlag {
+    uint32_t name;
+    int32_t value;
+};
+
+struct SavedNpc {
+    uint32_t map, npc;
+    float x, y;
+    int32_t direction;
+};
+
+// Everything that outlives a map: global flags (event progress included) and where NPCs were left.
+// Kept in its saved layout as the game runs, so saving is a handful of writes straight from these arrays
+struct WorldState {
+    std::vector<char> nameText;                     // NUL terminated names
+    std::vector<uint32_t> nameOffsets;
+    std::vector<SavedFlag> flags;
+    std::vector<SavedNpc> npcs;
+    SavedPlayer player = {};
+
+    std::unordered_map<NameId, uint32_t> slots;     // NameId -> nameOffsets index
+    std::unordered_map<uint32_t, uint32_t> flagIndex;
+    std::unordered_map<uint64_t, uint32_t> npcIndex;
+
+    uint32_t slot(NameId name) {
+        auto it = slots.find(name);
+        if (it != slots.end()) return it->second;
+        const std::string& str = nameOf(name);
+        nameOffsets.push_back(nameText.size());
+        nameText.insert(nameText.end(), str.begin(), str.end());
+        nameText.push_back('\0');
+        slots.emplace(name, nameOffsets.size() - 1);
+        return nameOffsets.size() - 1;
+    }
+
+    NameId slotName(uint32_t s) const {
+        return intern(&nameText[nameOffsets[s]]);
+    }
+
+    int flag(NameId name) const {
+        auto s = slots.find(name);
+        if (s == slots.end()) return 0;
+        auto it = flagIndex.find(s->second);
+        return (it != flagIndex.end()) ? flags[it->second].value : 0;
+    }
+
+    void setFlag(NameId name, int value) {
+        uint32_t s = slot(name);
+        auto it = flagIndex.find(s);
+        if (it != flagIndex.end()) {
+            flags[it->second].value = value;
+            return;
+        }
+        flagIndex.emplace(s, flags.size());
+        flags.push_back({ s, value });
+    }
+
+    static uint64_t npcKey(uint32_t map, uint32_t npc) {
+        return ((uint64_t)map << 32) | npc;
+    }
+
+    const SavedNpc* findNpc(NameId map, NameId npc) const {
+        auto m = slots.find(map), n = slots.find(npc);
+        if (m == slots.end() || n == slots.end()) return nullptr;
+        auto it = npcIndex.find(npcKey(m->second, n->second));
+        return (it != npcIndex.end()) ? &npcs[it->second] : nullptr;
+    }
+
+    void storeNpc(NameId map, NameId npc, float x, float y, int direction) {
+        SavedNpc saved = { slot(map), slot(npc), x, y, direction };
+        auto it = npcIndex.find(npcKey(saved.map, saved.npc));
+        if (it != npcIndex.end()) {
+            npcs[it->second] = saved;
+            return;
+        }
+        npcIndex.emplace(npcKey(saved.map, saved.npc), npcs.size());
+        npcs.push_back(saved);
+    }
+
+    // Written next to the target and renamed over it, a crash mid-save keeps the previous file
+    bool save(const std::string& path) const {
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream f(tmpPath, std::ios::binary);
+            f.write((const char*)&SAVE_MAGIC, 4);
+            f.write((const char*)&SAVE_VERSION, 4);
+            f.write((const char*)&player, sizeof(player));
+            writeArray(f, nameText);
+            writeArray(f, nameOffsets);
+            writeArray(f, flags);
+            writeArray(f, npcs);
+            if (!f) {
+                TraceLog(LOG_WARNING, "SAVE: Could not write %s", tmpPath.c_str());
+                return false;
+            }
+        }
+        return replaceFile(tmpPath, path);
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream f(path, std::ios::binary);
+        if (!f) return false;
+        uint32_t magic = 0, version = 0;
+        f.read((char*)&magic, 4);
+        f.read((char*)&version, 4);
+        if (!f || magic != SAVE_MAGIC || version != SAVE_VERSION) {
+            TraceLog(LOG_WARNING, "SAVE: %s is not a version %u save", path.c_str(), SAVE_VERSION);
+            return false;
+        }
+        WorldState loaded;
+        f.read((char*)&loaded.player, sizeof(loaded.player));
+        if (!f || !readArray(f, loaded.nameText) || !readArray(f, loaded.nameOffsets)
+            || !readArray(f, loaded.flags) || !readArray(f, loaded.npcs)) {
+            TraceLog(LOG_WARNING, "SAVE: %s is truncated", path.c_str());
+            return false;
+        }
+        if (loaded.nameText.empty() || loaded.nameText.back() != '\0') return false;
+        for (uint32_t offset : loaded.nameOffsets)
+            if (offset >= loaded.nameText.size()) return false;
+        size_t names = loaded.nameOffsets.size();
+        if (loaded.player.map >= names) return false;
+
+        for (uint32_t s = 0; s < names; s++)
+            loaded.slots.emplace(loaded.slotName(s), s);
+        for (uint32_t i = 0; i < loaded.flags.size(); i++) {
+            if (loaded.flags[i].name >= names) return false;
+            loaded.flagIndex.emplace(loaded.flags[i].name, i);
+        }
+        for (uint32_t i = 0; i < loaded.npcs.size(); i++) {
+            if (loaded.npcs[i].map >= names || loaded.npcs[i].npc >= names) return false;
+            loaded.npcIndex.emplace(npcKey(loaded.npcs[i].map, loaded.npcs[i].npc), i);
+        }
+        *this = std::move(loaded);
+        return true;
+    }
 };
 
+WorldState world;
+
+// Ambient behaviour from the spawn point "behaviour" property, only runs outside events and dialogues
+enum NpcBehaviour { BEHAVIOUR_NONE, BEHAVIOUR_IDLE, BEHAVIOUR_WANDER };
+
+// How often NpcScheduler updates an NPC, picked every frame from its distance to the camera
+enum NpcLod { LOD_NEAR, LOD_FAR, LOD_FROZEN };
+
+// Spritesheets are streamed in by NpcSprites when the NPC gets near the camera
+enum NpcSpriteState { SPRITE_UNLOADED, SPRITE_LOADING, SPRITE_LOADED, SPRITE_FAILED };
+
+// Width and height from the IHDR chunk, without decoding the image
+bool readPngSize(const std::string& path, int& width, int& height) {
+    std::ifstream f(path, std::ios::binary);
+    unsigned char h[24];
+    if (!f.read((char*)h, sizeof(h)) || memcmp(h, "\x89PNG\r\n\x1a\n", 8) != 0 || memcmp(h + 12, "IHDR", 4) != 0)
+        return false;
+    width = (h[16] << 24) | (h[17] << 16) | (h[18] << 8) | h[19];
+    height = (h[20] << 24) | (h[21] << 16) | (h[22] << 8) | h[23];
+    return true;
+}
+
 struct NPC {
-    std::string name;
+    NameId name;
 
     float x, y;
     Rectangle body;
@@ -108,20 +999,35 @@ struct NPC {
     float spriteW;
     float spriteH;
 
+    int clip = CLIP_WALK;
     int frame = 0;
     float frameTimer = 0.0f;
-    float frameMaxTimer = 0.10f;
     int direction = DOWN;
     int default_direction = DOWN;
+    int atlas = 0;
 
     float speed = 150.0f;
 
-    Dialogue dialogue;
-    bool hasDialogue = false;
+    const Dialogue* dialogue = nullptr;     // dialogueDB entry, nullptr if the NPC has nothing to say
+
+    int behaviour = BEHAVIOUR_NONE;
+    int homeX = 0, homeY = 0;               // Spawn tile, wandering stays around it
+    int wanderRadius = 3;                   // Tiles
+    float behaviourTimer = 0.0f;            // Seconds until the next turn or walk
+    bool walking = false;
+    int walkDirection = DOWN;
+    float walkTarget = 0.0f;
+
+    int lod = LOD_NEAR;
+    float owedTime = 0.0f;                  // Seconds not simulated yet, caught up by the next update
+    bool visible = true;                    // Sprite inside the camera view, animation and drawing are skipped otherwise
+
+    int spriteState = SPRITE_UNLOADED;      // texture.id is 0 unless loaded, width and height are always set
+    float spriteIdle = 0.0f;                // Seconds out of streaming range
 
     NPC() { }
 
-    void buildNpc(std::string& frame_, std::string& name_, float& x_, float& y_) {
+    void buildNpc(std::string& frame_, NameId name_, float& x_, float& y_) {
         name = name_;
         x = x_;
         y = y_;
@@ -129,20 +1035,23 @@ struct NPC {
         direction = loadFrame(frame_);
         default_direction = direction;
 
-        Image image = LoadImage((RESOURCE_PATH + name + ".png").c_str());
-        texture = LoadTextureFromImage(image);
-        UnloadImage(image);
+        // Only the size for now, the sheet itself is streamed in once the NPC is near the camera
+        texture = {};
+        if (!readPngSize(RESOURCE_PATH + nameOf(name) + ".png", texture.width, texture.height)) {
+            TraceLog(LOG_WARNING, "NPC: No spritesheet for %s", nameOf(name).c_str());
+            texture.width = LpcSheet::columns * LpcSheet::frameSize;
+            texture.height = LpcSheet::rows * LpcSheet::frameSize;
+        }
 
-        spriteW = (float)texture.width / 13;
-        spriteH = (float)texture.height / 54;
+        spriteW = (float)texture.width / LpcSheet::columns;
+        spriteH = (float)texture.height / LpcSheet::rows;
 
         updateBody();
     }
 
-    void buildNpc(std::string& frame_, std::string& name_, float& x_, float& y_, Dialogue& d) {
+    void buildNpc(std::string& frame_, NameId name_, float& x_, float& y_, const Dialogue* d) {
         buildNpc(frame_, name_, x_, y_);
         dialogue = d;
-        hasDialogue = true;
     }
 
     int loadFrame(std::string frame_) {
@@ -174,12 +1083,20 @@ struct NPC {
         }
     }
 
+    void play(int clip_) {
+        if (clip == clip_) return;
+        clip = clip_;
+        frame = 0;
+        frameTimer = 0.0f;
+    }
+
     void updateFrame(float frameTime) {
+        const AnimationClip& c = LpcSheet::clip(clip);
         frameTimer += frameTime;
 
-        if (frameTimer >= frameMaxTimer) {
-            frameTimer -= frameMaxTimer;
-            frame = (frame + 1) % 9;            // This 9 represents 9 frames in walking animation, should be changed if more animations are needed
+        if (frameTimer >= c.frameTime) {
+            frameTimer -= c.frameTime;
+            frame = (frame + 1) % c.frames;
         }
     }
 };
@@ -192,11 +1109,11 @@ struct Player {
     float spriteW;
     float spriteH;
     const float PLAYER_MARGIN = 1.0f;
+    int atlas = 0;
 
+    int clip = CLIP_IDLE;
     int frame = 0;
-    //int frameCount = 4;
     float frameTimer = 0.0f;
-    float frameMaxTimer = 0.10f;
     
     int direction = DOWN;
 
@@ -210,10 +1127,10 @@ struct Player {
 
     Event* ongoingEvent = nullptr;
     
-    Dialogue* currentDialogue = nullptr;
+    const Dialogue* currentDialogue = nullptr;
     NPC* currentDialogueNPC = nullptr;
     int dialogueIndex = 0;
-    int visibleChars = 0;
+    int visibleChars = 0;           // Codepoints, not bytes
     float textTimer = 0.0f;
     float textSpeed = 0.03f;
     bool lineFinished = false;
@@ -221,17 +1138,17 @@ struct Player {
 
     Player() {
         Image image = LoadImage((RESOURCE_PATH + "character-spritesheet.png").c_str());
-        texture = LoadTextureFromImage(image);
+        texture = loadTextureFromImage(image, VRAM_CHARACTERS);
         UnloadImage(image);
 
-        spriteW = (float)texture.width / 13;
-        spriteH = (float)texture.height / 54;
+        spriteW = (float)texture.width / LpcSheet::columns;
+        spriteH = (float)texture.height / LpcSheet::rows;
 
         updatePlayerBody();
     }
 
     ~Player() {
-        UnloadTexture(texture);
+        unloadTexture(texture);
     }
 
     void updatePlayerBody() {
@@ -242,21 +1159,30 @@ struct Player {
         body = Rectangle{x + 22.0f, y + 25.0f, 20.0f, 8.0f};
     }
 
+    void play(int clip_) {
+        if (clip == clip_) return;
+        clip = clip_;
+        frame = 0;
+        frameTimer = 0.0f;
+    }
+
     void updatePlayerFrame(float frameTime) {
+        const AnimationClip& c = LpcSheet::clip(clip);
         frameTimer += frameTime;
 
-        if (frameTimer >= frameMaxTimer) {
-            frameTimer -= frameMaxTimer;
-            frame = (frame + 1) % 9;            // This 9 represents 9 frames in walking animation, should be changed if more animations are needed
+        if (frameTimer >= c.frameTime) {
+            frameTimer -= c.frameTime;
+            frame = (frame + 1) % c.frames;
         }
     }
 
-    void updatePlayerAnimation(float frameTime, float dx, float dy, int lastKey) {
+    void updatePlayerAnimation(float frameTime, float dx, float dy, int lastKey, bool running) {
         if (dx == 0 && dy == 0) {
-            frame = 0;
-            frameTimer = 0;
+            play(CLIP_IDLE);
+            updatePlayerFrame(frameTime);
             return;
         }
+        play(running ? CLIP_RUN : CLIP_WALK);
         
         if (IsKeyUp(lastKey))
             switch (lastKey) { 
@@ -324,6 +1250,7 @@ struct TileAnimationFrame {
 
 struct Tileset {
     Texture2D texture;
+    std::string image;          // Path the texture was loaded from, reused across loads
     int firstGid;
     int tileWidth;
     int tileHeight;
@@ -332,617 +1259,4701 @@ struct Tileset {
     std::map<int, std::vector<TileAnimationFrame>> animations;
 };
 
+enum TileStorageKind {
+    TILES_DENSE, TILES_SPARSE, TILES_RLE
+};
+
+// Gids of one tile layer. Overlay layers (AlwaysAbove, Details, Drawables) are mostly zeros, so each layer is
+// stored in whichever form is smallest and iterating it only visits the non-empty tiles
+struct TileStorage {
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    TileStorageKind kind = TILES_DENSE;
+    int width = 0, height = 0;
+    bool wide = false;                  // 32 bit gids, only when the tilesets go past 65535
+
+    // DENSE: one gid per cell. SPARSE: one per non-empty cell. RLE: one per run of equal non-empty gids
+    std::pmr::vector<uint16_t> gids16;
+    std::pmr::vector<int> gids32;
+    std::pmr::vector<uint32_t> cells;   // SPARSE: cell index, RLE: first cell of the run
+    std::pmr::vector<uint16_t> lengths; // RLE only
+
+    TileStorage() = default;
+    explicit TileStorage(const allocator_type& a) : gids16(a), gids32(a), cells(a), lengths(a) { }
+    TileStorage(const TileStorage& o, const allocator_type& a)
+        : kind(o.kind), width(o.width), height(o.height), wide(o.wide),
+          gids16(o.gids16, a), gids32(o.gids32, a), cells(o.cells, a), lengths(o.lengths, a) { }
+    TileStorage(TileStorage&& o, const allocator_type& a)
+        : kind(o.kind), width(o.width), height(o.height), wide(o.wide),
+          gids16(std::move(o.gids16), a), gids32(std::move(o.gids32), a), cells(std::move(o.cells), a), lengths(std::move(o.lengths), a) { }
+
+    int gid(size_t i) const {
+        return wide ? gids32[i] : gids16[i];
+    }
+
+    void pushGid(int gid) {
+        if (wide) gids32.push_back(gid);
+        else gids16.push_back((uint16_t)gid);
+    }
+
+    void reserveGids(size_t count) {
+        if (wide) gids32.reserve(count);
+        else gids16.reserve(count);
+    }
+
+    void assign(const std::vector<int>& data, int width_, int height_) {
+        width = width_;
+        height = height_;
+        gids16.clear();
+        gids32.clear();
+        cells.clear();
+        lengths.clear();
+
+        int filled = 0, runs = 0, maxGid = 0;
+        for (size_t i = 0; i < data.size(); i++) {
+            if (data[i] <= 0) continue;
+            filled++;
+            maxGid = std::max(maxGid, data[i]);
+            if (i == 0 || data[i - 1] != data[i]) runs++;
+        }
+        wide = maxGid > 0xFFFF;
+
+        size_t gidBytes = wide ? 4 : 2;
+        size_t denseBytes = data.size() * gidBytes;
+        size_t sparseBytes = filled * (4 + gidBytes);
+        size_t rleBytes = runs * (4 + 2 + gidBytes);
+
+        // Sized up front, level layers live in a monotonic arena where growing wastes the old block
+        if (denseBytes <= sparseBytes && denseBytes <= rleBytes) {
+            kind = TILES_DENSE;
+            reserveGids(data.size());
+            for (int g : data) pushGid(std::max(g, 0));
+        }
+        else if (sparseBytes <= rleBytes) {
+            kind = TILES_SPARSE;
+            reserveGids(filled);
+            cells.reserve(filled);
+            for (size_t i = 0; i < data.size(); i++) {
+                if (data[i] <= 0) continue;
+                cells.push_back(i);
+                pushGid(data[i]);
+            }
+        }
+        else {
+            kind = TILES_RLE;
+            reserveGids(runs);
+            cells.reserve(runs);
+            lengths.reserve(runs);
+            for (size_t i = 0; i < data.size(); i++) {
+                if (data[i] <= 0) continue;
+                if (!cells.empty() && cells.back() + lengths.back() == i && gid(cells.size() - 1) == data[i] && lengths.back() < 0xFFFF) {
+                    lengths.back()++;
+                    continue;
+                }
+                cells.push_back(i);
+                lengths.push_back(1);
+                pushGid(data[i]);
+            }
+        }
+    }
+
+    // f(x, y, gid) for every non-empty tile, row by row
+    template <typename F>
+    void forEach(F&& f) const {
+        switch (kind) {
+            case TILES_DENSE:
+                for (int i = 0; i < width * height; i++) {
+                    int g = gid(i);
+                    if (g > 0) f(i % width, i / width, g);
+                }
+                break;
+            case TILES_SPARSE:
+                for (size_t i = 0; i < cells.size(); i++)
+                    f(cells[i] % width, cells[i] / width, gid(i));
+                break;
+            case TILES_RLE:
+                for (size_t r = 0; r < cells.size(); r++) {
+                    int g = gid(r);
+                    for (uint32_t c = cells[r]; c < cells[r] + lengths[r]; c++)
+                        f(c % width, c / width, g);
+                }
+                break;
+        }
+    }
+
+    int at(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) return 0;
+        uint32_t c = y * width + x;
+        switch (kind) {
+            case TILES_DENSE:
+                return gid(c);
+            case TILES_SPARSE: {
+                auto it = std::lower_bound(cells.begin(), cells.end(), c);
+                return (it != cells.end() && *it == c) ? gid(it - cells.begin()) : 0;
+            }
+            case TILES_RLE: {
+                auto it = std::upper_bound(cells.begin(), cells.end(), c);
+                if (it == cells.begin()) return 0;
+                size_t r = (it - cells.begin()) - 1;
+                return (c < cells[r] + lengths[r]) ? gid(r) : 0;
+            }
+        }
+        return 0;
+    }
+
+    size_t bytes() const {
+        return gids16.size() * 2 + gids32.size() * 4 + cells.size() * 4 + lengths.size() * 2;
+    }
+};
+
 struct TileLayer {
-    std::string name;
-    std::vector<int> data;
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    NameId name;
+    TileStorage data;
     int width;
     int height;
+
+    TileLayer() = default;
+    explicit TileLayer(const allocator_type& a) : data(a) { }
+    TileLayer(const TileLayer& o, const allocator_type& a) : name(o.name), data(o.data, a), width(o.width), height(o.height) { }
+    TileLayer(TileLayer&& o, const allocator_type& a) : name(o.name), data(std::move(o.data), a), width(o.width), height(o.height) { }
 };
 
 struct WorldObject {
     int x, y;           // Careful not to input floats in the editor
     int endX, endY, startX, startY;
-    std::string layer;
+    NameId layer;
 };
 
 struct SpawnPoint {
-    std::string who, name, frame;
+    std::string who, frame;
+    NameId name;
     float x, y;
-    std::string dialogue = "";
+    NameId dialogue = NO_NAME;
+    int behaviour = BEHAVIOUR_NONE;
+    int radius = 3;
 };
 
 struct DialoguePoint {
     Rectangle trigger;
-    std::string src;
+    NameId src;
 };
 
 struct EventPoint {
     Rectangle trigger;
-    std::string name;
+    NameId name;
 };
 
-struct Map {
-    std::vector<TileLayer> layers;
-    std::vector<Tileset> tilesets;
-    std::vector<std::vector<int>> collisions;
-    std::vector<Drawable> staticDrawables;
-    std::vector<Drawable> dynamicDrawables;
-    std::vector<WorldObject> worldObjects;
-    std::vector<Transition> transitions;
-    std::vector<SpawnPoint> spawnPoints;
-    std::vector<DialoguePoint> dialoguePoints;
-    std::vector<Dialogue> dialogues;
-    std::vector<NPC> npcs;
-    std::vector<EventPoint> eventPoints;
-    std::vector<Event> events;
+struct Light {
+    Vector2 position;           // World pixels
+    float radius;               // World pixels
+    Color color;
+    float intensity;
+    bool flicker;               // Drawn every frame with a flicker instead of baked
+};
 
-    std::string playerSpawnName;
-    SpawnPoint playerSpawn;
-    int height, width = 0;
+// Tiled writes colors as #AARRGGBB, or #RRGGBB when fully opaque
+Color parseTiledColor(const std::string& s, Color fallback) {
+    if ((s.size() != 7 && s.size() != 9) || s[0] != '#') return fallback;
+    unsigned long v = std::stoul(s.substr(1), nullptr, 16);
+    unsigned char a = (s.size() == 9) ? (unsigned char)(v >> 24) : 255;
+    return { (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v, a };
+}
 
-    std::vector<Rectangle> debugColliders;
+int floorDiv(int a, int b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
 
-    Map() { }
+// Infinite maps: tiles, collisions and drawables only exist for the chunks around the camera.
+// The .tmj chunks are repacked once into <map>.chunks so any chunk can be read on its own
+const uint32_t CHUNKPACK_MAGIC = 0x50434945;       // "EICP"
+const uint32_t CHUNKPACK_VERSION = 1;
+const int STREAM_RADIUS = 2;                        // Chunks kept resident around the camera
 
-    ~Map() {
-        for (Tileset& ts : tilesets)
-            UnloadTexture(ts.texture);
-    }
+// RenderItem positions are 16 bit, so a finite map, or the resident window of an infinite one, has to fit
+const int RENDER_RANGE_TILES = INT16_MAX / tileSize;
 
-    void loadMap(const std::string& filename, const std::string& spawn) {
-        playerSpawnName = spawn;
-        loadFromTMJ(RESOURCE_PATH + filename + ".tmj");
-        loadCollisions((RESOURCE_PATH + filename + "_collisions.csv").c_str());
-        loadStaticDrawables();
-        loadDialogues((RESOURCE_PATH + filename + "_dialogues.json").c_str());
-        loadNpcs();
-        loadEvents((RESOURCE_PATH + filename + "_events.json").c_str());
-    }
+struct MapChunk {
+    int cx, cy;
+    std::vector<TileStorage> layers;               // ChunkStreamer::layerNames order
+    std::vector<int> collisions;                   // Same values as the collisions csv, -1 for nothing
+    std::vector<RenderItem> drawables;             // Sorted, positions relative to the chunk's top-left
+};
 
-    void loadFromTMJ(const std::string& filename) {
-        layers.clear();
-        tilesets.clear();
-        worldObjects.clear();
-        transitions.clear();
-        spawnPoints.clear();
-        eventPoints.clear();
+uint64_t chunkKey(int cx, int cy) {
+    return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+}
 
-        json j = loadJson(filename);
+struct ChunkStreamer {
+    struct IndexEntry {
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    std::string path;
+    int chunkWidth = 16, chunkHeight = 16;
+    int radius = STREAM_RADIUS;
+    std::vector<NameId> layerNames;
+    int collisionLayer = -1;
+    int collisionFirstGid = 0;
+
+    // Copied from the map so the worker never reads it
+    std::vector<int> tilesetFirstGids;
+    std::vector<WorldObject> worldObjects;
 
-        // Load tilesets
-        for (json forTileset : j["tilesets"]) {
-            json jsonTileset;
-            // .tsj
-            std::string imgPath;
-            if (forTileset.contains("source")) {
-                std::string tsjRelative = forTileset["source"];
-                std::string tsjPath = RESOURCE_PATH + tsjRelative;
-                jsonTileset = loadJson(tsjPath);
-                std::string tsjFolder = tsjRelative.substr(0, tsjRelative.find_last_of("/\\") + 1);
-                imgPath = RESOURCE_PATH + tsjFolder + jsonTileset["image"].get<std::string>();
-            }
-            // .png
-            else {
-                jsonTileset = forTileset;
-                imgPath = RESOURCE_PATH + jsonTileset["image"].get<std::string>();
-            }
-                
-            Texture2D tex = LoadTexture(imgPath.c_str());
-            SetTextureFilter(tex, TEXTURE_FILTER_POINT);
+    std::unordered_map<uint64_t, IndexEntry> index;
+    std::unordered_map<uint64_t, std::unique_ptr<MapChunk>> resident;
+    std::unordered_set<uint64_t> pending;
+    bool changed = false;                           // Resident set changed since the map last looked
+    int centerX = 0, centerY = 0;                   // Chunk the camera was last in
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<uint64_t> jobs;
+    std::vector<std::unique_ptr<MapChunk>> finished;
+    bool quit = false;
+
+    ~ChunkStreamer() {
+        stop();
+    }
 
-            Tileset tileset;
-            tileset.texture = tex;
-            tileset.firstGid   = forTileset["firstgid"].get<int>();
-            tileset.tileWidth  = jsonTileset["tilewidth"].get<int>();
-            tileset.tileHeight = jsonTileset["tileheight"].get<int>();
-            tileset.columns    = jsonTileset["columns"].get<int>();
+    bool readHeader(std::ifstream& f, long sourceModTime) {
+        uint32_t magic = 0, version = 0, layerCount = 0, chunkCount = 0;
+        int64_t modTime = 0;
+        f.read((char*)&magic, 4);
+        f.read((char*)&version, 4);
+        f.read((char*)&modTime, 8);
+        if (!f || magic != CHUNKPACK_MAGIC || version != CHUNKPACK_VERSION || modTime != sourceModTime) return false;
+
+        f.read((char*)&chunkWidth, 4);
+        f.read((char*)&chunkHeight, 4);
+        f.read((char*)&collisionLayer, 4);
+        if ((2 * radius + 3) * std::max(chunkWidth, chunkHeight) > RENDER_RANGE_TILES) {
+            TraceLog(LOG_WARNING, "STREAM: %dx%d chunks are too large to draw around the camera", chunkWidth, chunkHeight);
+            return false;
+        }
+        f.read((char*)&layerCount, 4);
+        layerNames.clear();
+        for (uint32_t i = 0; i < layerCount; i++) {
+            uint32_t len = 0;
+            f.read((char*)&len, 4);
+            std::string name(len, '\0');
+            f.read(name.data(), len);
+            layerNames.push_back(intern(name));
+        }
 
-            // Animations
-            if (jsonTileset.contains("tiles")) {
-                for (json tile : jsonTileset["tiles"]) {
-                    if (!tile.contains("animation")) continue;
+        f.read((char*)&chunkCount, 4);
+        index.clear();
+        for (uint32_t i = 0; i < chunkCount; i++) {
+            int32_t cx, cy;
+            IndexEntry entry;
+            f.read((char*)&cx, 4);
+            f.read((char*)&cy, 4);
+            f.read((char*)&entry.offset, 8);
+            f.read((char*)&entry.size, 4);
+            index[chunkKey(cx, cy)] = entry;
+        }
+        return (bool)f;
+    }
 
-                    int tileId = tile["id"].get<int>();
+    // Only index and metadata are read here, chunk data stays on disk until it's needed
+    bool open(const std::string& packPath, long sourceModTime) {
+        std::ifstream f(packPath, std::ios::binary);
+        if (!f) return false;
+        path = packPath;
+        return readHeader(f, sourceModTime);
+    }
 
-                    for (json frame : tile["animation"]) {
-                        tileset.animations[tileId].push_back({
-                            frame["tileid"].get<int>(),
-                            frame["duration"].get<int>()
-                        });
+    // Repacks every tile layer chunk of an infinite .tmj, one compressed blob per chunk
+    static void writePack(const std::string& packPath, long sourceModTime, const json& j) {
+        std::vector<std::string> names;
+        std::vector<const json*> tileLayers;
+        int32_t collisions = -1;
+        int32_t cw = 0, ch = 0;
+        for (const json& layer : j["layers"]) {
+            if (layer["type"] != "tilelayer" || !layer.contains("chunks")) continue;
+            if (layer["name"] == "Collisions") collisions = names.size();
+            names.push_back(layer["name"].get<std::string>());
+            tileLayers.push_back(&layer);
+            for (const json& chunk : layer["chunks"]) {
+                cw = chunk["width"].get<int>();
+                ch = chunk["height"].get<int>();
+                break;
+            }
+        }
+        if (cw <= 0 || ch <= 0) { cw = 16; ch = 16; }
+        if ((2 * STREAM_RADIUS + 3) * std::max(cw, ch) > RENDER_RANGE_TILES)
+            TraceLog(LOG_WARNING, "STREAM: %dx%d chunks are too large to draw around the camera, use smaller chunks", cw, ch);
+
+        std::map<std::pair<int, int>, std::vector<int32_t>> chunks;
+        for (size_t li = 0; li < tileLayers.size(); li++) {
+            std::string encoding = tileLayers[li]->value("encoding", "csv");
+            std::string compression = tileLayers[li]->value("compression", "");
+            for (const json& chunk : (*tileLayers[li])["chunks"]) {
+                int x = chunk["x"].get<int>();
+                int y = chunk["y"].get<int>();
+                int w = chunk["width"].get<int>();
+                int h = chunk["height"].get<int>();
+                std::vector<int> data = readTileData(chunk, encoding, compression, w * h);
+                for (int ty = 0; ty < h; ty++)
+                    for (int tx = 0; tx < w; tx++) {
+                        int gid = data[ty * w + tx];
+                        if (gid <= 0) continue;
+                        int wx = x + tx, wy = y + ty;
+                        std::vector<int32_t>& blob = chunks[{floorDiv(wx, cw), floorDiv(wy, ch)}];
+                        if (blob.empty()) blob.assign(names.size() * cw * ch, 0);
+                        int lx = wx - floorDiv(wx, cw) * cw;
+                        int ly = wy - floorDiv(wy, ch) * ch;
+                        blob[li * cw * ch + ly * cw + lx] = gid;
                     }
-                }
             }
+        }
 
-            tilesets.push_back(tileset);
+        std::vector<std::pair<unsigned char*, int>> blobs;
+        for (auto& [pos, blob] : chunks) {
+            int size = 0;
+            unsigned char* comp = CompressData((const unsigned char*)blob.data(), blob.size() * sizeof(int32_t), &size);
+            blobs.push_back({comp, size});
         }
 
-        // Load layers
-        for (json layer : j["layers"]) {
-            if (layer["type"] == "tilelayer") {
-                if (layer["name"] == "Collisions") continue;        //Ignore collisions, they are parsed separately
+        uint64_t headerSize = 4 + 4 + 8 + 4 + 4 + 4 + 4 + 4;
+        for (std::string& n : names) headerSize += 4 + n.size();
+        headerSize += chunks.size() * (4 + 4 + 8 + 4);
+
+        std::ofstream f(packPath, std::ios::binary | std::ios::trunc);
+        uint32_t magic = CHUNKPACK_MAGIC, version = CHUNKPACK_VERSION, count = names.size();
+        int64_t modTime = sourceModTime;
+        f.write((char*)&magic, 4);
+        f.write((char*)&version, 4);
+        f.write((char*)&modTime, 8);
+        f.write((char*)&cw, 4);
+        f.write((char*)&ch, 4);
+        f.write((char*)&collisions, 4);
+        f.write((char*)&count, 4);
+        for (std::string& n : names) {
+            uint32_t len = n.size();
+            f.write((char*)&len, 4);
+            f.write(n.data(), len);
+        }
+        count = chunks.size();
+        f.write((char*)&count, 4);
+        uint64_t offset = headerSize;
+        size_t i = 0;
+        for (auto& [pos, blob] : chunks) {
+            int32_t cx = pos.first, cy = pos.second;
+            uint32_t size = blobs[i++].second;
+            f.write((char*)&cx, 4);
+            f.write((char*)&cy, 4);
+            f.write((char*)&offset, 8);
+            f.write((char*)&size, 4);
+            offset += size;
+        }
+        for (auto& [data, size] : blobs) {
+            f.write((char*)data, size);
+            MemFree(data);
+        }
+    }
 
-                TileLayer tlayer;
-                tlayer.name   = layer["name"].get<std::string>();
-                tlayer.width  = layer["width"].get<int>();
-                tlayer.height = layer["height"].get<int>();
-                tlayer.data   = layer["data"].get<std::vector<int>>();
+    std::unique_ptr<MapChunk> buildChunk(std::ifstream& f, uint64_t key) {
+        std::unique_ptr<MapChunk> chunk = std::make_unique<MapChunk>();
+        chunk->cx = (int32_t)(key >> 32);
+        chunk->cy = (int32_t)(key & 0xFFFFFFFFu);
+        int tiles = chunkWidth * chunkHeight;
+
+        const IndexEntry& entry = index.at(key);
+        std::vector<unsigned char> comp(entry.size);
+        f.clear();
+        f.seekg(entry.offset);
+        f.read((char*)comp.data(), entry.size);
+
+        int size = 0;
+        unsigned char* raw = DecompressData(comp.data(), entry.size, &size);
+        std::vector<std::vector<int>> data(layerNames.size(), std::vector<int>(tiles, 0));
+        if (raw && size == (int)(layerNames.size() * tiles * sizeof(int32_t))) {
+            for (size_t li = 0; li < layerNames.size(); li++)
+                memcpy(data[li].data(), raw + li * tiles * sizeof(int32_t), tiles * sizeof(int32_t));
+        }
+        if (raw) MemFree(raw);
 
-                layers.push_back(tlayer);
-            }
-            else if (layer["type"] == "objectgroup") {
+        int ox = chunk->cx * chunkWidth;
+        int oy = chunk->cy * chunkHeight;
 
-                if (layer["name"] == LAYER_WORLDOBJECTS) {
-                    for (json obj : layer["objects"]) {
-                        if (!obj.contains("properties")) continue;
-                        WorldObject wo;
-                        for (json property : obj["properties"]) {
-                            if (property["name"] == "endX")
-                                wo.endX = property["value"].get<int>();
-                            else if (property["name"] == "endY")
-                                wo.endY = property["value"].get<int>();
-                            else if (property["name"] == "layer")
-                                wo.layer = property["value"].get<std::string>();
-                            else if (property["name"] == "startX")
-                                wo.startX = property["value"].get<int>();
-                            else if (property["name"] == "startY")
-                                wo.startY = property["value"].get<int>();
-                        }
-                        wo.x = obj["x"].get<int>() / 16;
-                        wo.y = obj["y"].get<int>() / 16;
-                        worldObjects.push_back(wo);
-                    }
-                }
+        chunk->collisions.assign(tiles, -1);
+        if (collisionLayer >= 0)
+            for (int i = 0; i < tiles; i++) {
+                int gid = data[collisionLayer][i];
+                if (gid > 0) chunk->collisions[i] = gid - collisionFirstGid;
+            }
 
-                else if (layer["name"] == LAYER_TRANSITIONS) {
-                    for (json obj : layer["objects"]) {
-                        if (!obj.contains("properties")) continue;
-                        Transition t;
-                        for (json property : obj["properties"]) {
-                            if (property["name"] == "map")
-                                t.map = property["value"].get<std::string>();
-                            else if (property["name"] == "spawnName")
-                                t.spawnName = property["value"].get<std::string>();
-                        }
-                        t.trigger = {
-                            obj["x"].get<float>() * 2.0f,           // Go from 16px tiles to 32px tiles
-                            obj["y"].get<float>() * 2.0f,
-                            obj["width"].get<float>() * 2.0f,
-                            obj["height"].get<float>() * 2.0f
-                        };
-                        transitions.push_back(t);
-                    }
-                }
+        for (size_t li = 0; li < layerNames.size(); li++) {
+            if (layerNames[li] != NAME_DRAWABLES) continue;
 
-                else if (layer["name"] == LAYER_SPAWNPOINTS) {
-                    for (json obj : layer["objects"]) {
-                        if (!obj.contains("properties")) continue;
-                        SpawnPoint sp;
-                        for (json property : obj["properties"]) {
-                            if (property["name"] == "who")
-                                sp.who = property["value"].get<std::string>();
-                            else if (property["name"] == "name")
-                                sp.name = property["value"].get<std::string>();
-                            else if (property["name"] == "frame")
-                                sp.frame = property["value"].get<std::string>();
-                            else if (property["name"] == "dialogue")
-                                sp.dialogue = property["value"].get<std::string>();
-                        }
-                        sp.x = obj["x"].get<float>() * 2.0f;
-                        sp.y = obj["y"].get<float>() * 2.0f;
-                        sp.x -= 16.0f;                          //Small offset accounting for ~16 blank pixels on most spritesheets
-                        if (sp.who == "player") {
-                            if (sp.name == playerSpawnName)
-                                playerSpawn = sp;
-                            continue;
-                        }
-                        spawnPoints.push_back(sp);
-                    }
-                }
+            std::vector<float> sortY(tiles);
+            for (int i = 0; i < tiles; i++)
+                sortY[i] = (float)((oy + i / chunkWidth + 1) * tileSize);
 
-                else if (layer["name"] == LAYER_DIALOGUES) {
-                    for (json obj : layer["objects"]) {
-                        if (!obj.contains("properties")) continue;
-                        DialoguePoint dp;
-                        for (json property : obj["properties"]) {
-                            if (property["name"] == "src")
-                                dp.src = property["value"].get<std::string>();
-                        }
-                        dp.trigger = {
-                            obj["x"].get<float>() * 2.0f,           // Go from 16px tiles to 32px tiles
-                            obj["y"].get<float>() * 2.0f,
-                            obj["width"].get<float>() * 2.0f,
-                            obj["height"].get<float>() * 2.0f
-                        };
-                        dialoguePoints.push_back(dp);
-                    }
-                }
+            // Objects may hang over the chunk edge, their anchor tile is always a full tile so sortY is known without it
+            for (WorldObject& wo : worldObjects) {
+                if (wo.layer != layerNames[li]) continue;
+                int anchor = (wo.y + 1) * tileSize;
+                for (int y = std::max(wo.startY+wo.y, oy); y < std::min(wo.endY+wo.y+1, oy + chunkHeight); y++)
+                    for (int x = std::max(wo.startX+wo.x, ox); x < std::min(wo.endX+wo.x+1, ox + chunkWidth); x++)
+                        sortY[(y - oy) * chunkWidth + (x - ox)] = anchor;
+            }
 
-                else if (layer["name"] == LAYER_EVENTS) {
-                    for (json obj : layer["objects"]) {
-                        if (!obj.contains("properties")) continue;
-                        EventPoint ep;
-                        for (json property : obj["properties"]) {
-                            if (property["name"] == "name")
-                                ep.name = property["value"].get<std::string>();
-                        }
-                        ep.trigger = {
-                            obj["x"].get<float>() * 2.0f,           // Go from 16px tiles to 32px tiles
-                            obj["y"].get<float>() * 2.0f,
-                            obj["width"].get<float>() * 2.0f,
-                            obj["height"].get<float>() * 2.0f
-                        };
-                        eventPoints.push_back(ep);
-                    }
-                }
+            for (int i = 0; i < tiles; i++) {
+                int gid = data[li][i];
+                if (gid <= 0) continue;
+                int ts = (int)(std::upper_bound(tilesetFirstGids.begin(), tilesetFirstGids.end(), gid) - tilesetFirstGids.begin()) - 1;
+                if (ts < 0) continue;
+                chunk->drawables.push_back({
+                    renderKey(sortY[i], chunk->drawables.size()),
+                    (int16_t)(i % chunkWidth * tileSize), (int16_t)(i / chunkWidth * tileSize),
+                    (uint16_t)ts, (uint16_t)(gid - tilesetFirstGids[ts])
+                });
             }
         }
+        std::sort(chunk->drawables.begin(), chunk->drawables.end(),
+            [](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
 
-        if (!layers.empty()) {
-            width = layers[0].width;
-            height = layers[0].height;
-        }
+        chunk->layers.resize(layerNames.size());
+        for (size_t li = 0; li < layerNames.size(); li++)
+            chunk->layers[li].assign(data[li], chunkWidth, chunkHeight);
+        return chunk;
     }
 
-    void loadCollisions(const char* filename) {
-        collisions.clear();
+    void workerLoop() {
+        memoryCategory = MEM_STREAMING;
+        std::ifstream f(path, std::ios::binary);
+        while (true) {
+            uint64_t key;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !jobs.empty(); });
+                if (quit) return;
+                key = jobs.front();
+                jobs.pop_front();
+            }
+            std::unique_ptr<MapChunk> chunk = buildChunk(f, key);
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back(std::move(chunk));
+        }
+    }
 
-        std::ifstream file(filename);
-        std::string line;
+    // Loads the chunks around center right away so the first frame has no holes, then streams in the background
+    void start(Vector2 center) {
+        std::ifstream f(path, std::ios::binary);
+        int ccx = floorDiv((int)floor(center.x / tileSize), chunkWidth);
+        int ccy = floorDiv((int)floor(center.y / tileSize), chunkHeight);
+        centerX = ccx;
+        centerY = ccy;
+        for (int cy = ccy - radius; cy <= ccy + radius; cy++)
+            for (int cx = ccx - radius; cx <= ccx + radius; cx++) {
+                uint64_t key = chunkKey(cx, cy);
+                if (index.count(key)) resident[key] = buildChunk(f, key);
+            }
+        changed = true;
 
-        while (std::getline(file, line)) {
-            std::vector<int> row;
-            std::string cell;
+        quit = false;
+        worker = std::thread(&ChunkStreamer::workerLoop, this);
+    }
 
-            for (char c : line) {
-                if (c == ',') {
-                    row.push_back(std::stoi(cell));
-                    cell.clear();
-                    continue;
-                } 
-                cell += c;
+    void stop() {
+        if (worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                quit = true;
             }
-            row.push_back(std::stoi(cell));
-            collisions.push_back(row);
+            wake.notify_all();
+            worker.join();
         }
+        jobs.clear();
+        finished.clear();
+        pending.clear();
+        resident.clear();
+        index.clear();
+        changed = true;
     }
 
-    void loadStaticDrawables() {
-        staticDrawables.clear();
-        for (TileLayer& layer : layers) {
-            if (layer.name != LAYER_DRAWABLES) continue;
-
-            for (int y = 0; y < layer.height; y++) {
-                for (int x = 0; x < layer.width; x++) {
-                    int gid = layer.data[y * layer.width + x];
-
-                    if (gid <= 0) continue;
-
-                    Tileset* ts = findTileset(gid);
-                    if (!ts) continue;
-
-                    int localId = gid - ts->firstGid;
-
-                    Rectangle src = {
-                        (float)((localId % ts->columns) * ts->tileWidth),
-                        (float)((localId / ts->columns) * ts->tileHeight),
-                        (float)ts->tileWidth,
-                        (float)ts->tileHeight
-                    };
-
-                    Rectangle dst = {
-                        (float)(x * tileSize),
-                        (float)(y * tileSize),
-                        (float)tileSize,
-                        (float)tileSize
-                    };
-
-                    Drawable d;
-                    d.texture = &ts->texture;
-                    d.src = src;
-                    d.dst = dst;
-                    d.sortY = dst.y + dst.height;
-
-                    d.x = x;
-                    d.y = y;
-                    d.layer = LAYER_DRAWABLES;
-                    staticDrawables.push_back(d);
-                }
+    bool wanted(uint64_t key, int ccx, int ccy, int r) {
+        int cx = (int32_t)(key >> 32);
+        int cy = (int32_t)(key & 0xFFFFFFFFu);
+        return abs(cx - ccx) <= r && abs(cy - ccy) <= r;
+    }
+
+    void update(Vector2 center) {
+        int ccx = floorDiv((int)floor(center.x / tileSize), chunkWidth);
+        int ccy = floorDiv((int)floor(center.y / tileSize), chunkHeight);
+        centerX = ccx;
+        centerY = ccy;
+
+        std::vector<std::unique_ptr<MapChunk>> arrived;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            arrived.swap(finished);
+
+            // Drop queued requests the camera already left behind
+            for (auto it = jobs.begin(); it != jobs.end();) {
+                if (wanted(*it, ccx, ccy, radius)) { ++it; continue; }
+                pending.erase(*it);
+                it = jobs.erase(it);
             }
-        }
 
-        // Update sortY to match object anchor
-        for (WorldObject wo : worldObjects) {
-            int anchor = -1;
-            for (Drawable& dr : staticDrawables) {
-                if ((dr.x == wo.x) && (dr.y == wo.y) && (dr.layer == wo.layer)) {
-                    anchor = dr.sortY;
-                    break;
+            for (int cy = ccy - radius; cy <= ccy + radius; cy++)
+                for (int cx = ccx - radius; cx <= ccx + radius; cx++) {
+                    uint64_t key = chunkKey(cx, cy);
+                    if (!index.count(key) || resident.count(key) || pending.count(key)) continue;
+                    pending.insert(key);
+                    jobs.push_back(key);
                 }
-            }
-            if (anchor == -1) continue;
-            for (int x = wo.startX+wo.x; x < wo.endX+wo.x+1; x++)
-                for (int y = wo.startY+wo.y; y < wo.endY+wo.y+1; y++)
-                    for (Drawable& dr : staticDrawables) {
-                        if ((dr.x == x) && (dr.y == y) && (dr.layer == wo.layer)) {
-                            dr.sortY = anchor;
-                            break;
-                        }
-                    }
+        }
+        wake.notify_one();
+
+        for (std::unique_ptr<MapChunk>& chunk : arrived) {
+            uint64_t key = chunkKey(chunk->cx, chunk->cy);
+            pending.erase(key);
+            if (!wanted(key, ccx, ccy, radius + 1)) continue;
+            resident[key] = std::move(chunk);
+            changed = true;
+        }
+
+        // One chunk of hysteresis so walking along a border doesn't thrash
+        for (auto it = resident.begin(); it != resident.end();) {
+            if (wanted(it->first, ccx, ccy, radius + 1)) { ++it; continue; }
+            it = resident.erase(it);
+            changed = true;
         }
     }
 
-    void loadDialogues(const char* filename) {
-        dialogues.clear();
+    MapChunk* chunkAt(int tx, int ty) {
+        auto it = resident.find(chunkKey(floorDiv(tx, chunkWidth), floorDiv(ty, chunkHeight)));
+        return (it != resident.end()) ? it->second.get() : nullptr;
+    }
 
-        json j = loadJson(filename);
-        
-        for (json d : j["dialogues"]) {
-            Dialogue dia;
-            dia.name = d["name"].get<std::string>();
-            for (json s : d["sentences"]) {
-                dia.speaker.push_back(s["speaker"].get<std::string>());
-                dia.msg.push_back(s["msg"].get<std::string>());
-            }
-            dialogues.push_back(dia);
+    int collisionAt(int tx, int ty) {
+        MapChunk* chunk = chunkAt(tx, ty);
+        if (!chunk) return true;                    // Not loaded yet, same as outside the map
+        int lx = tx - chunk->cx * chunkWidth;
+        int ly = ty - chunk->cy * chunkHeight;
+        return chunk->collisions[ly * chunkWidth + lx];
+    }
+};
+
+// Reports files written in the resources folder so the current map can be reloaded while the game runs.
+// Uses inotify on Linux, on other platforms it never reports anything
+struct FileWatcher {
+    int fd = -1;
+
+    void start(const std::string& folder) {
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0 || inotify_add_watch(fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            TraceLog(LOG_WARNING, "WATCH: Could not watch %s, hot reload disabled", folder.c_str());
+            stop();
         }
+#endif
     }
 
-    void loadNpcs() {
-        npcs.clear();
-        for (SpawnPoint& sp : spawnPoints) {
-            if (sp.who != "npc")
-                continue;
-            if (sp.dialogue != "") {
-                for (Dialogue& dia : dialogues) {
-                    if (sp.dialogue == dia.name) {
-                        npcs.emplace_back();
-                        npcs.back().buildNpc(sp.frame, sp.name, sp.x, sp.y, dia);
-                    }
-                }
-            }
-            else {
-                npcs.emplace_back();
-                npcs.back().buildNpc(sp.frame, sp.name, sp.x, sp.y);
+    void stop() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+        fd = -1;
+    }
+
+    ~FileWatcher() { stop(); }
+
+    // Never blocks, editors that save through a temp file show up as a rename (IN_MOVED_TO)
+    std::vector<std::string> poll() {
+        std::vector<std::string> changed;
+#ifdef __linux__
+        if (fd < 0) return changed;
+        alignas(inotify_event) char buffer[4096];
+        ssize_t len;
+        while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + len; ) {
+                inotify_event* ev = (inotify_event*)p;
+                if (ev->len > 0 && std::find(changed.begin(), changed.end(), ev->name) == changed.end())
+                    changed.push_back(ev->name);
+                p += sizeof(inotify_event) + ev->len;
             }
         }
+#endif
+        return changed;
     }
+};
 
-    EventAction parseAction(const json& a) {
-        EventAction action;
-        std::string str_type = a["type"].get<std::string>();
-        EventActionType type = ACTION_DIALOGUE;                     // Should never keep this, but compiler will throw warning if it's not there
-        if (str_type == "ACTION_DIALOGUE") type = ACTION_DIALOGUE;
-        if (str_type == "ACTION_MOVE_NPC") type = ACTION_MOVE_NPC;
-        if (str_type == "ACTION_MOVE_CAMERA") type = ACTION_MOVE_CAMERA;
-        if (str_type == "ACTION_MOVE_PLAYER") type = ACTION_MOVE_PLAYER;
-        if (str_type == "ACTION_GROUP") type = ACTION_GROUP;
-        action.type = type;
-        if ((type == ACTION_MOVE_CAMERA) || (type == ACTION_MOVE_NPC) || (type == ACTION_MOVE_PLAYER)) {
-            action.tiles = a["tiles"].get<int>();
-            std::string str_direction = a["direction"].get<std::string>();
-            int direction = RIGHT;                                              // Again, should never keep this value
-            if (str_direction == "RIGHT") direction = RIGHT;
-            if (str_direction == "LEFT") direction = LEFT;
+// Pathfinding on the collision grid of finite maps (-1 is walkable). Moves are 8-way with octile costs and
+// never cut a blocked corner. Requests are answered by a worker thread, see PathService
+struct GridPoint {
+    int x, y;
+
+    bool operator==(const GridPoint& o) const { return x == o.x && y == o.y; }
+};
+
+struct GridRect {
+    int x0, y0, x1, y1;         // Inclusive
+
+    bool contains(int x, int y) const { return x >= x0 && y >= y0 && x <= x1 && y <= y1; }
+};
+
+const int PATH_STRAIGHT = 10;
+const int PATH_DIAGONAL = 14;
+const int HPA_CLUSTER = 10;                         // Cluster side in tiles
+const int HPA_MIN_DISTANCE = 2 * HPA_CLUSTER;       // Shorter queries are cheaper with plain JPS
+const int PATH_SLICE_NODES = 256;                   // Expansions and jump-scanned tiles a search gets before the worker moves on
+const int FLOWFIELD_MIN_REQUESTS = 3;               // Queued requests to one goal before a shared field pays off
+const size_t FLOWFIELD_CACHE = 4;
+const size_t PATH_CACHE = 64;
+
+int octile(int dx, int dy) {
+    dx = abs(dx);
+    dy = abs(dy);
+    return PATH_STRAIGHT * std::max(dx, dy) + (PATH_DIAGONAL - PATH_STRAIGHT) * std::min(dx, dy);
+}
+
+// NPC sprites are 64x64 with the body near the bottom, paths go through the tile under the body center
+GridPoint npcTile(const NPC& npc) {
+    return { (int)floor((npc.x + 32.0f) / tileSize), (int)floor((npc.y + 25.0f) / tileSize) };
+}
+
+Vector2 npcPositionAt(GridPoint tile) {
+    return { tile.x * tileSize + tileSize/2.0f - 32.0f, tile.y * tileSize + tileSize/2.0f - 25.0f };
+}
+
+struct NavGrid {
+    int width = 0, height = 0;
+    std::vector<uint8_t> walkable;
+
+    bool open(int x, int y) const {
+        return x >= 0 && y >= 0 && x < width && y < height && walkable[y * width + x];
+    }
+
+    GridRect bounds() const { return { 0, 0, width - 1, height - 1 }; }
+
+    int neighbours(const GridRect& r, int x, int y, GridPoint out[8]) const {
+        auto pass = [&](int nx, int ny) { return r.contains(nx, ny) && open(nx, ny); };
+        int count = 0;
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dx = -1; dx <= 1; dx++) {
+                if ((!dx && !dy) || !pass(x + dx, y + dy)) continue;
+                if (dx && dy && !(pass(x + dx, y) && pass(x, y + dy))) continue;
+                out[count++] = { x + dx, y + dy };
+            }
+        return count;
+    }
+};
+
+// A* that can be stopped after any number of expansions and resumed later. With jps only jump points are
+// expanded, path() fills in the tiles between them. Tiles passed by jump scans are charged to the budget too
+struct GridSearch {
+    struct Node {
+        int g;
+        int parent;
+        bool closed;
+    };
+
+    enum Status { SEARCH_RUNNING, SEARCH_FOUND, SEARCH_FAILED };
+
+    const NavGrid* grid = nullptr;
+    GridRect area;
+    GridPoint start, goal;
+    bool jps = false;
+    Status status = SEARCH_FAILED;
+    int cost = 0;
+    int expansions = 0;                         // Since begin()
+    int scanned = 0;                            // Tiles jump() passed that step() hasn't charged yet
+    std::unordered_map<int, Node> nodes;
+    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<>> open;     // (f, tile)
+
+    bool pass(int x, int y) const { return area.contains(x, y) && grid->open(x, y); }
+
+    void begin(const NavGrid& grid_, const GridRect& area_, GridPoint from, GridPoint to, bool jps_) {
+        grid = &grid_;
+        area = area_;
+        start = from;
+        goal = to;
+        jps = jps_;
+        cost = 0;
+        expansions = 0;
+        scanned = 0;
+        nodes.clear();
+        open = {};
+        if (!pass(from.x, from.y) || !pass(to.x, to.y)) {
+            status = SEARCH_FAILED;
+            return;
+        }
+        status = SEARCH_RUNNING;
+        int s = from.y * grid->width + from.x;
+        nodes[s] = { 0, -1, false };
+        open.push({ octile(to.x - from.x, to.y - from.y), s });
+    }
+
+    // Runs to completion in one call, for the short bounded searches of HPA*
+    bool run(const NavGrid& grid_, const GridRect& area_, GridPoint from, GridPoint to) {
+        begin(grid_, area_, from, to, false);
+        while (!step(INT_MAX)) { }
+        return status == SEARCH_FOUND;
+    }
+
+    // True once the search is over
+    bool step(int budget) {
+        if (status != SEARCH_RUNNING) return true;
+        int w = grid->width;
+        GridPoint succ[8];
+        while (budget > 0) {
+            if (open.empty()) {
+                status = SEARCH_FAILED;
+                return true;
+            }
+            int cur = open.top().second;
+            open.pop();
+            budget--;
+            Node& n = nodes[cur];
+            if (n.closed) continue;
+            n.closed = true;
+            expansions++;
+            int g = n.g, parent = n.parent;             // n is gone once new nodes are inserted
+            int cx = cur % w, cy = cur / w;
+            if (cx == goal.x && cy == goal.y) {
+                status = SEARCH_FOUND;
+                cost = g;
+                return true;
+            }
+
+            int count = jps ? jumpSuccessors(cx, cy, parent, succ) : grid->neighbours(area, cx, cy, succ);
+            budget -= scanned;
+            scanned = 0;
+            for (int i = 0; i < count; i++) {
+                int idx = succ[i].y * w + succ[i].x;
+                int ng = g + octile(succ[i].x - cx, succ[i].y - cy);
+                auto it = nodes.find(idx);
+                if (it != nodes.end() && (it->second.closed || it->second.g <= ng)) continue;
+                nodes[idx] = { ng, cur, false };
+                open.push({ ng + octile(goal.x - succ[i].x, goal.y - succ[i].y), idx });
+            }
+        }
+        return false;
+    }
+
+    // Neighbours worth looking at coming from parent, then jumped along their direction
+    int jumpSuccessors(int x, int y, int parent, GridPoint out[8]) {
+        GridPoint candidates[8];
+        int count = 0;
+        if (parent < 0)
+            count = grid->neighbours(area, x, y, candidates);
+        else {
+            int dx = (x > parent % grid->width) - (x < parent % grid->width);
+            int dy = (y > parent / grid->width) - (y < parent / grid->width);
+            auto add = [&](int nx, int ny) { candidates[count++] = { nx, ny }; };
+            if (dx && dy) {
+                bool vertical = pass(x, y + dy), horizontal = pass(x + dx, y);
+                if (vertical) add(x, y + dy);
+                if (horizontal) add(x + dx, y);
+                if (vertical && horizontal && pass(x + dx, y + dy)) add(x + dx, y + dy);
+            }
+            else if (dx) {
+                bool next = pass(x + dx, y), below = pass(x, y + 1), above = pass(x, y - 1);
+                if (next) {
+                    add(x + dx, y);
+                    if (below && pass(x + dx, y + 1)) add(x + dx, y + 1);
+                    if (above && pass(x + dx, y - 1)) add(x + dx, y - 1);
+                }
+                if (below) add(x, y + 1);
+                if (above) add(x, y - 1);
+            }
+            else {
+                bool next = pass(x, y + dy), right = pass(x + 1, y), left = pass(x - 1, y);
+                if (next) {
+                    add(x, y + dy);
+                    if (right && pass(x + 1, y + dy)) add(x + 1, y + dy);
+                    if (left && pass(x - 1, y + dy)) add(x - 1, y + dy);
+                }
+                if (right) add(x + 1, y);
+                if (left) add(x - 1, y);
+            }
+        }
+
+        int found = 0;
+        for (int i = 0; i < count; i++) {
+            int dx = candidates[i].x - x, dy = candidates[i].y - y;
+            if (jump(candidates[i].x, candidates[i].y, dx, dy, out[found]))
+                found++;
+        }
+        return found;
+    }
+
+    bool jump(int x, int y, int dx, int dy, GridPoint& out) {
+        for (;;) {
+            scanned++;
+            if (!pass(x, y)) return false;
+            if (x == goal.x && y == goal.y) break;
+            if (dx && dy) {
+                GridPoint straight;
+                if (jump(x + dx, y, dx, 0, straight) || jump(x, y + dy, 0, dy, straight)) break;
+                if (!pass(x + dx, y) || !pass(x, y + dy)) return false;
+            }
+            else if (dx) {
+                if ((pass(x, y - 1) && !pass(x - dx, y - 1)) || (pass(x, y + 1) && !pass(x - dx, y + 1))) break;
+            }
+            else if ((pass(x - 1, y) && !pass(x - 1, y - dy)) || (pass(x + 1, y) && !pass(x + 1, y - dy)))
+                break;
+            x += dx;
+            y += dy;
+        }
+        out = { x, y };
+        return true;
+    }
+
+    // Every tile from start to goal, jump points are joined by straight or diagonal runs
+    void path(std::vector<GridPoint>& out) const {
+        std::vector<GridPoint> points;
+        for (int idx = goal.y * grid->width + goal.x; idx >= 0; idx = nodes.at(idx).parent)
+            points.push_back({ idx % grid->width, idx / grid->width });
+        std::reverse(points.begin(), points.end());
+
+        out.push_back(points[0]);
+        for (size_t i = 1; i < points.size(); i++) {
+            GridPoint p = points[i - 1];
+            int dx = (points[i].x > p.x) - (points[i].x < p.x), dy = (points[i].y > p.y) - (points[i].y < p.y);
+            while (!(p == points[i])) {
+                p = { p.x + dx, p.y + dy };
+                out.push_back(p);
+            }
+        }
+    }
+};
+
+// HPA*: the map is cut in clusters, walkable spans on cluster borders become entrance nodes linked to their
+// neighbour across the border and to every other entrance of the cluster they can reach. Long queries search
+// that small graph and only refine it with searches bounded to one cluster
+struct HpaGraph {
+    struct Edge {
+        int to, cost;
+    };
+
+    int clustersX = 0, clustersY = 0;
+    std::vector<GridPoint> nodes;
+    std::vector<std::vector<Edge>> edges;
+    std::vector<std::vector<int>> clusterNodes;
+    std::unordered_map<int, int> nodeAt;            // Tile index -> node
+
+    bool empty() const { return nodes.empty(); }
+
+    int cluster(GridPoint p) const { return (p.y / HPA_CLUSTER) * clustersX + p.x / HPA_CLUSTER; }
+
+    GridRect clusterArea(const NavGrid& grid, int c) const {
+        int x0 = (c % clustersX) * HPA_CLUSTER, y0 = (c / clustersX) * HPA_CLUSTER;
+        return { x0, y0, std::min(x0 + HPA_CLUSTER, grid.width) - 1, std::min(y0 + HPA_CLUSTER, grid.height) - 1 };
+    }
+
+    int node(const NavGrid& grid, GridPoint p) {
+        auto [it, added] = nodeAt.emplace(p.y * grid.width + p.x, (int)nodes.size());
+        if (added) {
+            nodes.push_back(p);
+            edges.emplace_back();
+            clusterNodes[cluster(p)].push_back(it->second);
+        }
+        return it->second;
+    }
+
+    void link(int a, int b, int cost) {
+        edges[a].push_back({ b, cost });
+        edges[b].push_back({ a, cost });
+    }
+
+    // a and b are the two sides of the border at the first tile of a span, step walks along it
+    void addEntrances(const NavGrid& grid, GridPoint a, GridPoint b, GridPoint step, int length) {
+        auto entrance = [&](int i) {
+            GridPoint pa = { a.x + step.x * i, a.y + step.y * i }, pb = { b.x + step.x * i, b.y + step.y * i };
+            link(node(grid, pa), node(grid, pb), PATH_STRAIGHT);
+        };
+        if (length < 6)
+            entrance(length / 2);
+        else {
+            entrance(0);
+            entrance(length - 1);
+        }
+    }
+
+    void build(const NavGrid& grid) {
+        clustersX = (grid.width + HPA_CLUSTER - 1) / HPA_CLUSTER;
+        clustersY = (grid.height + HPA_CLUSTER - 1) / HPA_CLUSTER;
+        nodes.clear();
+        edges.clear();
+        nodeAt.clear();
+        clusterNodes.assign(clustersX * clustersY, {});
+
+        // Spans open on both sides of every vertical border, then every horizontal one
+        for (int x = HPA_CLUSTER; x < grid.width; x += HPA_CLUSTER)
+            for (int y0 = 0; y0 < grid.height; y0 += HPA_CLUSTER) {
+                int y1 = std::min(y0 + HPA_CLUSTER, grid.height), start = -1;
+                for (int y = y0; y <= y1; y++) {
+                    bool open = y < y1 && grid.open(x - 1, y) && grid.open(x, y);
+                    if (open && start < 0) start = y;
+                    if (!open && start >= 0) {
+                        addEntrances(grid, { x - 1, start }, { x, start }, { 0, 1 }, y - start);
+                        start = -1;
+                    }
+                }
+            }
+        for (int y = HPA_CLUSTER; y < grid.height; y += HPA_CLUSTER)
+            for (int x0 = 0; x0 < grid.width; x0 += HPA_CLUSTER) {
+                int x1 = std::min(x0 + HPA_CLUSTER, grid.width), start = -1;
+                for (int x = x0; x <= x1; x++) {
+                    bool open = x < x1 && grid.open(x, y - 1) && grid.open(x, y);
+                    if (open && start < 0) start = x;
+                    if (!open && start >= 0) {
+                        addEntrances(grid, { start, y - 1 }, { start, y }, { 1, 0 }, x - start);
+                        start = -1;
+                    }
+                }
+            }
+
+        GridSearch search;
+        for (size_t c = 0; c < clusterNodes.size(); c++) {
+            const std::vector<int>& inside = clusterNodes[c];
+            for (size_t i = 0; i < inside.size(); i++)
+                for (size_t j = i + 1; j < inside.size(); j++)
+                    if (search.run(grid, clusterArea(grid, c), nodes[inside[i]], nodes[inside[j]]))
+                        link(inside[i], inside[j], search.cost);
+        }
+    }
+};
+
+// One HPA* query, worked through a budget at a time so PathService can slice it like a grid search. Start and
+// goal join the graph for this query only, as node ids nodes.size() and nodes.size() + 1. Joining them and
+// refining the path are searches bounded to one cluster, each of those runs whole and is charged afterwards
+struct HpaQuery {
+    enum Phase { JOIN_START, JOIN_GOAL, ABSTRACT, REFINE, DONE };
+
+    const HpaGraph* graph = nullptr;
+    const NavGrid* grid = nullptr;
+    GridPoint from, to;
+    int S = 0, G = 0, cs = 0, cg = 0;
+    Phase phase = DONE;
+    bool found = false;
+    size_t next = 0;                                // Cluster node being joined, then abstract path step being refined
+    GridSearch search;
+    std::vector<HpaGraph::Edge> startEdges;
+    std::unordered_map<int, int> goalEdges;
+    std::vector<int> g, parent, abstractPath;
+    std::vector<uint8_t> closed;
+    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<>> open;
+    std::vector<GridPoint> tiles, segment;          // tiles is the result, start and goal included
+
+    void begin(const HpaGraph& graph_, const NavGrid& grid_, GridPoint from_, GridPoint to_) {
+        graph = &graph_;
+        grid = &grid_;
+        from = from_;
+        to = to_;
+        S = (int)graph->nodes.size();
+        G = S + 1;
+        cs = graph->cluster(from);
+        cg = graph->cluster(to);
+        phase = JOIN_START;
+        found = false;
+        next = 0;
+        startEdges.clear();
+        goalEdges.clear();
+        tiles.clear();
+    }
+
+    GridPoint position(int n) const { return n == S ? from : (n == G ? to : graph->nodes[n]); }
+
+    void relax(int u, int v, int cost) {
+        if (closed[v] || g[u] + cost >= g[v]) return;
+        g[v] = g[u] + cost;
+        parent[v] = u;
+        GridPoint p = position(v);
+        open.push({ g[v] + octile(to.x - p.x, to.y - p.y), v });
+    }
+
+    // True once the query is over, found and tiles hold the result
+    bool step(int budget) {
+        while (budget > 0) {
+            switch (phase) {
+            case JOIN_START: {
+                const std::vector<int>& inside = graph->clusterNodes[cs];
+                if (next < inside.size()) {
+                    int n = inside[next++];
+                    if (search.run(*grid, graph->clusterArea(*grid, cs), from, graph->nodes[n]))
+                        startEdges.push_back({ n, search.cost });
+                    budget -= std::max(search.expansions, 1);
+                    break;
+                }
+                next = 0;
+                phase = JOIN_GOAL;
+                break;
+            }
+            case JOIN_GOAL: {
+                const std::vector<int>& inside = graph->clusterNodes[cg];
+                if (next < inside.size()) {
+                    int n = inside[next++];
+                    if (search.run(*grid, graph->clusterArea(*grid, cg), graph->nodes[n], to))
+                        goalEdges[n] = search.cost;
+                    budget -= std::max(search.expansions, 1);
+                    break;
+                }
+                if (cs == cg) {
+                    if (search.run(*grid, graph->clusterArea(*grid, cs), from, to))
+                        startEdges.push_back({ G, search.cost });
+                    budget -= std::max(search.expansions, 1);
+                }
+                g.assign(S + 2, INT_MAX);
+                parent.assign(S + 2, -1);
+                closed.assign(S + 2, 0);
+                open = {};
+                g[S] = 0;
+                open.push({ octile(to.x - from.x, to.y - from.y), S });
+                phase = ABSTRACT;
+                break;
+            }
+            case ABSTRACT: {
+                if (open.empty()) {
+                    phase = DONE;
+                    return true;
+                }
+                int u = open.top().second;
+                open.pop();
+                budget--;
+                if (closed[u]) break;
+                closed[u] = 1;
+                if (u == G) {
+                    abstractPath.clear();
+                    for (int n = G; n >= 0; n = parent[n])
+                        abstractPath.push_back(n);
+                    std::reverse(abstractPath.begin(), abstractPath.end());
+                    tiles.push_back(from);
+                    next = 1;
+                    phase = REFINE;
+                    break;
+                }
+                if (u == S) {
+                    for (const HpaGraph::Edge& e : startEdges) relax(u, e.to, e.cost);
+                    break;
+                }
+                for (const HpaGraph::Edge& e : graph->edges[u]) relax(u, e.to, e.cost);
+                auto it = goalEdges.find(u);
+                if (it != goalEdges.end()) relax(u, G, it->second);
+                break;
+            }
+            // Border crossings are one step, everything else is a search inside one cluster
+            case REFINE: {
+                if (next >= abstractPath.size()) {
+                    found = true;
+                    phase = DONE;
+                    return true;
+                }
+                GridPoint a = position(abstractPath[next - 1]), b = position(abstractPath[next]);
+                next++;
+                budget--;
+                if (a == b) break;
+                if (graph->cluster(a) != graph->cluster(b)) {
+                    tiles.push_back(b);
+                    break;
+                }
+                search.run(*grid, graph->clusterArea(*grid, graph->cluster(a)), a, b);
+                budget -= search.expansions;
+                segment.clear();
+                search.path(segment);
+                tiles.insert(tiles.end(), segment.begin() + 1, segment.end());
+                break;
+            }
+            case DONE:
+                return true;
+            }
+        }
+        return phase == DONE;
+    }
+};
+
+// Dijkstra from the goal over the whole grid, every NPC heading there walks downhill
+void buildFlowField(const NavGrid& grid, GridPoint goal, std::vector<int>& cost) {
+    cost.assign(grid.width * grid.height, INT_MAX);
+    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<>> open;
+    int g = goal.y * grid.width + goal.x;
+    cost[g] = 0;
+    open.push({ 0, g });
+    GridPoint next[8];
+    while (!open.empty()) {
+        auto [c, cur] = open.top();
+        open.pop();
+        if (c > cost[cur]) continue;
+        int x = cur % grid.width, y = cur / grid.width;
+        int count = grid.neighbours(grid.bounds(), x, y, next);
+        for (int i = 0; i < count; i++) {
+            int idx = next[i].y * grid.width + next[i].x;
+            int nc = c + octile(next[i].x - x, next[i].y - y);
+            if (nc >= cost[idx]) continue;
+            cost[idx] = nc;
+            open.push({ nc, idx });
+        }
+    }
+}
+
+bool followFlowField(const NavGrid& grid, const std::vector<int>& cost, GridPoint from, std::vector<GridPoint>& out) {
+    if (cost[from.y * grid.width + from.x] == INT_MAX) return false;
+    GridPoint p = from, next[8];
+    out.push_back(p);
+    while (cost[p.y * grid.width + p.x] > 0) {
+        int here = cost[p.y * grid.width + p.x];
+        int count = grid.neighbours(grid.bounds(), p.x, p.y, next);
+        for (int i = 0; i < count; i++) {
+            int c = cost[next[i].y * grid.width + next[i].x];
+            if (c != INT_MAX && c + octile(next[i].x - p.x, next[i].y - p.y) == here) {
+                p = next[i];
+                break;
+            }
+        }
+        out.push_back(p);
+    }
+    return true;
+}
+
+// Immutable once published, searches in flight keep the one they started with alive through a map load
+struct NavData {
+    uint32_t generation = 0;
+    NavGrid grid;
+    HpaGraph hpa;
+};
+
+struct PathResult {
+    bool found = false;
+    std::vector<GridPoint> tiles;       // Start and goal included
+};
+
+// Path requests are queued from the main thread and answered by one worker. Each search, JPS or HPA*, runs for
+// a slice of PATH_SLICE_NODES before the next request gets its turn, so a long query can't hold up the short
+// ones behind it. Results wait in finished until polled.
+// The worker picks per request: cached path, shared flow field when FLOWFIELD_MIN_REQUESTS want the same
+// goal, HPA* for long queries, otherwise JPS
+struct PathService {
+    struct Job {
+        uint32_t ticket;
+        std::shared_ptr<const NavData> nav;
+        GridPoint from, to;
+        bool started = false;
+        bool hierarchical = false;
+        GridSearch search;
+        HpaQuery hpa;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::shared_ptr<const NavData> nav;
+    std::deque<std::unique_ptr<Job>> inbox;
+    std::unordered_map<uint32_t, PathResult> finished;
+    std::unordered_set<uint32_t> cancelled;
+    uint32_t nextTicket = 1;
+    bool quit = false;
+
+    // Worker only
+    std::vector<std::unique_ptr<Job>> active;
+    uint32_t cacheGeneration = 0;
+    std::unordered_map<uint64_t, std::vector<GridPoint>> paths;
+    std::deque<uint64_t> pathOrder;                                     // Oldest first
+    std::deque<std::pair<int, std::vector<int>>> flowFields;            // (goal tile, cost), oldest first
+
+    PathService() { }
+
+    ~PathService() { stop(); }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    // Finished results stay: a collision hot reload swaps the grid under a PathNpc that hasn't polled yet,
+    // and tickers of a map being left cancel their own tickets
+    void setNav(std::shared_ptr<const NavData> data) {
+        std::lock_guard<std::mutex> lock(mutex);
+        nav = std::move(data);
+    }
+
+    uint32_t request(GridPoint from, GridPoint to) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t ticket = nextTicket++;
+        if (!nav) {                                     // Infinite maps have no grid, fail right away
+            finished[ticket] = {};
+            return ticket;
+        }
+        if (!worker.joinable())
+            worker = std::thread(&PathService::run, this);
+        inbox.push_back(std::make_unique<Job>(Job{ ticket, nav, from, to }));
+        wake.notify_one();
+        return ticket;
+    }
+
+    bool poll(uint32_t ticket, PathResult& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = finished.find(ticket);
+        if (it == finished.end()) return false;
+        out = std::move(it->second);
+        finished.erase(it);
+        return true;
+    }
+
+    void cancel(uint32_t ticket) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!finished.erase(ticket))
+            cancelled.insert(ticket);
+    }
+
+    void run() {
+        memoryCategory = MEM_NAVIGATION;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !inbox.empty() || !active.empty(); });
+                if (quit) return;
+                while (!inbox.empty()) {
+                    active.push_back(std::move(inbox.front()));
+                    inbox.pop_front();
+                }
+            }
+
+            for (size_t i = 0; i < active.size(); ) {
+                PathResult result;
+                if (!slice(*active[i], result)) {
+                    i++;
+                    continue;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!cancelled.erase(active[i]->ticket))
+                        finished[active[i]->ticket] = std::move(result);
+                }
+                active.erase(active.begin() + i);
+            }
+        }
+    }
+
+    // True when the job is done and result is filled
+    bool slice(Job& job, PathResult& result) {
+        const NavGrid& grid = job.nav->grid;
+        uint64_t key = ((uint64_t)(job.from.y * grid.width + job.from.x) << 32) | (uint32_t)(job.to.y * grid.width + job.to.x);
+
+        if (!job.started) {
+            job.started = true;
+            if (job.nav->generation != cacheGeneration) {
+                cacheGeneration = job.nav->generation;
+                paths.clear();
+                pathOrder.clear();
+                flowFields.clear();
+            }
+            if (!grid.open(job.from.x, job.from.y) || !grid.open(job.to.x, job.to.y))
+                return true;
+
+            auto cached = paths.find(key);
+            if (cached != paths.end()) {
+                result = { true, cached->second };
+                return true;
+            }
+
+            const std::vector<int>* field = flowField(job);
+            if (field)
+                result.found = followFlowField(grid, *field, job.from, result.tiles);
+            else if (!job.nav->hpa.empty() && octile(job.to.x - job.from.x, job.to.y - job.from.y) >= HPA_MIN_DISTANCE * PATH_STRAIGHT) {
+                job.hierarchical = true;
+                job.hpa.begin(job.nav->hpa, grid, job.from, job.to);
+                return false;
+            }
+            else {
+                job.search.begin(grid, grid.bounds(), job.from, job.to, true);
+                return false;
+            }
+        }
+        else if (job.hierarchical) {
+            if (!job.hpa.step(PATH_SLICE_NODES)) return false;
+            result.found = job.hpa.found;
+            if (result.found) result.tiles = std::move(job.hpa.tiles);
+        }
+        else {
+            if (!job.search.step(PATH_SLICE_NODES)) return false;
+            result.found = job.search.status == GridSearch::SEARCH_FOUND;
+            if (result.found) job.search.path(result.tiles);
+        }
+
+        if (result.found) {
+            if (paths.size() >= PATH_CACHE) {
+                paths.erase(pathOrder.front());
+                pathOrder.pop_front();
+            }
+            if (paths.emplace(key, result.tiles).second)
+                pathOrder.push_back(key);
+        }
+        return true;
+    }
+
+    // Existing field for the goal, or a new one if enough active jobs head there
+    const std::vector<int>* flowField(const Job& job) {
+        int goal = job.to.y * job.nav->grid.width + job.to.x;
+        for (auto& [g, cost] : flowFields)
+            if (g == goal) return &cost;
+
+        int demand = 0;
+        for (const std::unique_ptr<Job>& other : active)
+            if (other->nav == job.nav && other->to == job.to) demand++;
+        if (demand < FLOWFIELD_MIN_REQUESTS) return nullptr;
+
+        if (flowFields.size() >= FLOWFIELD_CACHE) flowFields.pop_front();
+        flowFields.emplace_back(goal, std::vector<int>());
+        buildFlowField(job.nav->grid, job.to, flowFields.back().second);
+        return &flowFields.back().second;
+    }
+};
+
+const int TILEMAP_ATLAS_WIDTH = 4096;
+const int TILEMAP_MAX_TEXTURE = 8192;
+const int TILEMAP_TABLE_WIDTH = 256;
+
+// Every texel lookup is a texelFetch, so the output matches DrawTexturePro with point filtering pixel for pixel.
+// tables holds three texels per gid (atlas x/y as 16 bit, tile width/height, first animation frame and frame
+// count as 16 bit), then two texels per animation frame (end time in ms as 24 bit, atlas x/y)
+const char* TILEMAP_FS = R"(#version 330
+in vec2 fragTexCoord;
+in vec4 fragColor;
+
+uniform sampler2D texture0;
+uniform sampler2D gids;
+uniform sampler2D tables;
+uniform vec4 colDiffuse;
+uniform int timeMs;
+uniform int gidCount;
+
+out vec4 finalColor;
+
+ivec4 fetchTable(int i) {
+    return ivec4(texelFetch(tables, ivec2(i % 256, i / 256), 0) * 255.0 + 0.5);
+}
+
+void main() {
+    vec2 cell = fragTexCoord * vec2(textureSize(texture0, 0));      // Layer position in tiles
+    ivec4 g = ivec4(texelFetch(gids, ivec2(cell), 0) * 255.0 + 0.5);
+    int gid = g.r | (g.g << 8) | (g.b << 16);
+    if (gid == 0 || gid >= gidCount) discard;
+
+    ivec4 pos = fetchTable(gid * 3);
+    ivec4 size = fetchTable(gid * 3 + 1);
+    ivec4 anim = fetchTable(gid * 3 + 2);
+    ivec2 origin = ivec2(pos.r | (pos.g << 8), pos.b | (pos.a << 8));
+
+    int count = anim.b | (anim.a << 8);
+    if (count > 0) {
+        int first = gidCount * 3 + (anim.r | (anim.g << 8)) * 2;
+        ivec4 last = fetchTable(first + (count - 1) * 2);
+        int t = timeMs % (last.r | (last.g << 8) | (last.b << 16));
+        for (int i = 0; i < count; i++) {
+            ivec4 end = fetchTable(first + i * 2);
+            if (t < (end.r | (end.g << 8) | (end.b << 16))) {
+                ivec4 frame = fetchTable(first + i * 2 + 1);
+                origin = ivec2(frame.r | (frame.g << 8), frame.b | (frame.a << 8));
+                break;
+            }
+        }
+    }
+
+    ivec2 texel = origin + ivec2(fract(cell) * vec2(size.rg));
+    finalColor = texelFetch(texture0, texel, 0) * colDiffuse * fragColor;
+}
+)";
+
+// Draws a whole tile layer as one quad, the fragment shader resolves gid, animation frame and texel.
+// Gids are uploaded once per layer as RGBA8 (gid in rgb), every tileset is packed into one atlas so a layer
+// needs no per-tileset passes. Only finite maps, streamed chunks keep the per-tile path
+struct TilemapRenderer {
+    Shader shader = {};
+    bool shaderTried = false, shaderOk = false;
+    int gidsLoc = -1, tablesLoc = -1, timeLoc = -1, gidCountLoc = -1;
+
+    Texture2D atlas = {};
+    Texture2D tables = {};
+    std::vector<Texture2D> layerGids;       // Same index as Map::layers
+    int gidCount = 0;
+    bool ready = false;
+
+    ~TilemapRenderer() {
+        release();
+        if (shaderOk) UnloadShader(shader);
+    }
+
+    void release() {
+        if (atlas.id) unloadTexture(atlas);
+        if (tables.id) unloadTexture(tables);
+        for (Texture2D& t : layerGids)
+            unloadTexture(t);
+        atlas = {};
+        tables = {};
+        layerGids.clear();
+        ready = false;
+    }
+
+    // A failed compile hands back raylib's default shader, which has none of our uniforms
+    bool loadShader() {
+        if (shaderTried) return shaderOk;
+        shaderTried = true;
+        shader = LoadShaderFromMemory(nullptr, TILEMAP_FS);
+        gidsLoc = GetShaderLocation(shader, "gids");
+        tablesLoc = GetShaderLocation(shader, "tables");
+        timeLoc = GetShaderLocation(shader, "timeMs");
+        gidCountLoc = GetShaderLocation(shader, "gidCount");
+        shaderOk = IsShaderValid(shader) && gidsLoc >= 0 && tablesLoc >= 0;
+        if (!shaderOk) TraceLog(LOG_WARNING, "TILEMAP: Shader unavailable, drawing tiles one by one");
+        return shaderOk;
+    }
+
+    static Color pack16(int a, int b) {
+        return { (unsigned char)(a & 255), (unsigned char)(a >> 8), (unsigned char)(b & 255), (unsigned char)(b >> 8) };
+    }
+
+    static Texture2D upload(std::vector<Color>& pixels, int width, int height) {
+        Image image = { pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+        Texture2D texture = loadTextureFromImage(image, VRAM_TILEMAP);
+        SetTextureFilter(texture, TEXTURE_FILTER_POINT);
+        return texture;
+    }
+
+    void build(const std::vector<Tileset>& tilesets, const std::pmr::vector<TileLayer>& layers) {
+        release();
+        if (tilesets.empty() || !loadShader()) return;
+
+        // Shelf packing in tileset order
+        std::vector<GridPoint> placement;
+        int x = 0, y = 0, shelf = 0, width = 0, maxTile = 0;
+        gidCount = 1;
+        for (const Tileset& ts : tilesets) {
+            if (x + ts.texture.width > TILEMAP_ATLAS_WIDTH) {
+                x = 0;
+                y += shelf;
+                shelf = 0;
+            }
+            placement.push_back({ x, y });
+            x += ts.texture.width;
+            width = std::max(width, x);
+            shelf = std::max(shelf, ts.texture.height);
+            gidCount = std::max(gidCount, ts.firstGid + ts.columns * (ts.texture.height / ts.tileHeight));
+            maxTile = std::max({ maxTile, ts.tileWidth, ts.tileHeight });
+        }
+        int height = y + shelf;
+        if (width == 0 || height == 0) return;                  // Every tileset image failed to load
+        if (width > TILEMAP_MAX_TEXTURE || height > TILEMAP_MAX_TEXTURE || gidCount >= (1 << 24)) {
+            TraceLog(LOG_WARNING, "TILEMAP: Tilesets don't fit a %dx%d atlas, drawing tiles one by one", TILEMAP_MAX_TEXTURE, TILEMAP_MAX_TEXTURE);
+            return;
+        }
+        if (maxTile > 255) {                                    // The table keeps tile width/height in a byte each
+            TraceLog(LOG_WARNING, "TILEMAP: %dpx tiles are too large for the tile table, drawing tiles one by one", maxTile);
+            return;
+        }
+
+        // Raw row copies, ImageDraw would blend the semi-transparent texels
+        std::vector<Color> pixels(width * height, BLANK);
+        for (size_t i = 0; i < tilesets.size(); i++) {
+            Image image = LoadImage(tilesets[i].image.c_str());
+            ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+            int rows = std::min(image.height, height - placement[i].y), cols = std::min(image.width, width - placement[i].x);
+            for (int row = 0; row < rows; row++)
+                memcpy(&pixels[(placement[i].y + row) * width + placement[i].x], (Color*)image.data + row * image.width, cols * sizeof(Color));
+            UnloadImage(image);
+        }
+        atlas = upload(pixels, width, height);
+
+        // Same tileset choice as Map::findTileset: the last one starting at or before the gid
+        std::vector<Color> table(gidCount * 3, BLANK), frames;
+        size_t ts = 0;
+        for (int gid = 1; gid < gidCount; gid++) {
+            while (ts + 1 < tilesets.size() && tilesets[ts + 1].firstGid <= gid) ts++;
+            const Tileset& set = tilesets[ts];
+            if (gid < set.firstGid) continue;
+            int local = gid - set.firstGid;
+            auto origin = [&](int id) {
+                return pack16(placement[ts].x + (id % set.columns) * set.tileWidth, placement[ts].y + (id / set.columns) * set.tileHeight);
+            };
+            table[gid * 3] = origin(local);
+            table[gid * 3 + 1] = { (unsigned char)set.tileWidth, (unsigned char)set.tileHeight, 0, 0 };
+
+            // A zero total would be a modulo by zero in the shader, such tiles stay on their static frame
+            auto it = set.animations.find(local);
+            if (it == set.animations.end() || it->second.empty()) continue;
+            int total = 0;
+            for (const TileAnimationFrame& f : it->second) total += f.duration;
+            if (total <= 0 || total >= (1 << 24)) continue;
+            int end = 0;
+            table[gid * 3 + 2] = pack16((int)frames.size() / 2, (int)it->second.size());
+            for (const TileAnimationFrame& f : it->second) {
+                end += f.duration;
+                frames.push_back({ (unsigned char)(end & 255), (unsigned char)((end >> 8) & 255), (unsigned char)((end >> 16) & 255), 0 });
+                frames.push_back(origin(f.tileId));
+            }
+        }
+        table.insert(table.end(), frames.begin(), frames.end());
+        int tableRows = ((int)table.size() + TILEMAP_TABLE_WIDTH - 1) / TILEMAP_TABLE_WIDTH;
+        if (tableRows > TILEMAP_MAX_TEXTURE) {
+            release();
+            return;
+        }
+        table.resize(tableRows * TILEMAP_TABLE_WIDTH, BLANK);
+        tables = upload(table, TILEMAP_TABLE_WIDTH, tableRows);
+
+        for (const TileLayer& layer : layers) {
+            std::vector<Color> cells(layer.width * layer.height, BLANK);
+            layer.data.forEach([&](int cx, int cy, int gid) {
+                if (gid > 0 && gid < gidCount)
+                    cells[cy * layer.width + cx] = { (unsigned char)(gid & 255), (unsigned char)((gid >> 8) & 255), (unsigned char)(gid >> 16), 255 };
+            });
+            layerGids.push_back(upload(cells, layer.width, layer.height));
+        }
+        ready = true;
+    }
+
+    // The source rectangle is in tiles so fragTexCoord times the atlas size gives the layer position
+    void drawLayer(size_t i, const TileLayer& layer) {
+        BeginShaderMode(shader);
+        SetShaderValueTexture(shader, gidsLoc, layerGids[i]);
+        SetShaderValueTexture(shader, tablesLoc, tables);
+        int time = (int)(GetTime() * 1000);
+        SetShaderValue(shader, timeLoc, &time, SHADER_UNIFORM_INT);
+        SetShaderValue(shader, gidCountLoc, &gidCount, SHADER_UNIFORM_INT);
+        DrawTexturePro(atlas, Rectangle{ 0, 0, (float)layer.width, (float)layer.height },
+            Rectangle{ 0, 0, (float)(layer.width * tileSize), (float)(layer.height * tileSize) }, {0,0}, 0, WHITE);
+        EndShaderMode();
+    }
+};
+
+const int LIGHT_CHUNK_TILES = 16;                   // Lightmap chunk side in tiles
+const int LIGHTMAP_TEXEL = 8;                       // World pixels per lightmap texel
+const int LIGHT_BUFFER_SCALE = 4;                   // Light buffer is a quarter of the internal resolution per axis
+const size_t MAX_DYNAMIC_LIGHTS = 32;
+const float DEFAULT_TORCH_TILES = 5.0f;
+const Color TORCH_COLOR = { 255, 200, 140, 255 };
+const Color DEFAULT_AMBIENT = { 60, 60, 80, 255 };  // Maps with lights but no "ambient" property
+
+// World rectangle the camera shows on the internal target
+Rectangle cameraView(const Camera2D& camera) {
+    return {
+        camera.target.x - camera.offset.x / camera.zoom,
+        camera.target.y - camera.offset.y / camera.zoom,
+        GAME_WIDTH / camera.zoom,
+        GAME_HEIGHT / camera.zoom
+    };
+}
+
+// Static lights are baked on the CPU into one lightmap per chunk they reach, chunks without one are plain
+// ambient. Every frame the visible lightmaps plus the dynamic lights (flickering ones and the player torch) are
+// drawn into a quarter resolution buffer, which is multiplied over the scene in one fullscreen pass
+struct Lighting {
+    struct Chunk {
+        int cx, cy;
+        Texture2D texture;
+    };
+
+    bool enabled = false;
+    Color ambient = WHITE;
+    std::vector<Chunk> chunks;
+    RenderTexture2D buffer = {};
+    Texture2D glow = {};
+
+    ~Lighting() {
+        releaseChunks();
+        if (buffer.id) unloadRenderTexture(buffer);
+        if (glow.id) unloadTexture(glow);
+    }
+
+    void releaseChunks() {
+        for (Chunk& c : chunks)
+            unloadTexture(c.texture);
+        chunks.clear();
+    }
+
+    // Chunks are split between threads, textures are created afterwards on the main thread
+    void bake(const std::pmr::vector<Light>& lights, Color ambient_, bool enabled_) {
+        releaseChunks();
+        enabled = enabled_;
+        ambient = ambient_;
+        ambient.a = 255;
+        if (!enabled) return;
+
+        double start = GetTime();
+        const int chunkPx = LIGHT_CHUNK_TILES * tileSize, texels = chunkPx / LIGHTMAP_TEXEL;
+        std::vector<GridPoint> keys;
+        std::unordered_set<uint64_t> seen;
+        for (const Light& l : lights) {
+            if (l.flicker) continue;
+            int x0 = floorDiv((int)floor(l.position.x - l.radius), chunkPx), x1 = floorDiv((int)floor(l.position.x + l.radius), chunkPx);
+            int y0 = floorDiv((int)floor(l.position.y - l.radius), chunkPx), y1 = floorDiv((int)floor(l.position.y + l.radius), chunkPx);
+            for (int cy = y0; cy <= y1; cy++)
+                for (int cx = x0; cx <= x1; cx++)
+                    if (seen.insert(((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy).second)
+                        keys.push_back({ cx, cy });
+        }
+
+        std::vector<std::vector<Color>> pixels(keys.size());
+        std::atomic<size_t> next{0};
+        auto work = [&] {
+            for (size_t i; (i = next++) < keys.size(); )
+                bakeChunk(lights, keys[i], pixels[i]);
+        };
+        unsigned threads = std::max(1u, std::min(std::thread::hardware_concurrency(), (unsigned)keys.size()));
+        std::vector<std::thread> helpers;
+        for (unsigned t = 1; t < threads; t++)
+            helpers.emplace_back(work);
+        work();
+        for (std::thread& t : helpers)
+            t.join();
+
+        for (size_t i = 0; i < keys.size(); i++) {
+            Image image = { pixels[i].data(), texels, texels, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+            Texture2D texture = loadTextureFromImage(image, VRAM_LIGHTING);
+            SetTextureFilter(texture, TEXTURE_FILTER_BILINEAR);
+            chunks.push_back({ keys[i].x, keys[i].y, texture });
+        }
+        TraceLog(LOG_INFO, "LIGHT: Baked %zu lightmaps on %u threads in %.2f ms", chunks.size(), threads, (GetTime() - start) * 1000.0);
+    }
+
+    // Ambient plus every static light reaching the texel center, quadratic falloff to zero at the radius
+    void bakeChunk(const std::pmr::vector<Light>& lights, GridPoint key, std::vector<Color>& out) const {
+        const int chunkPx = LIGHT_CHUNK_TILES * tileSize, texels = chunkPx / LIGHTMAP_TEXEL;
+        Rectangle area = { (float)(key.x * chunkPx), (float)(key.y * chunkPx), (float)chunkPx, (float)chunkPx };
+        std::vector<const Light*> reaching;
+        for (const Light& l : lights)
+            if (!l.flicker && CheckCollisionCircleRec(l.position, l.radius, area))
+                reaching.push_back(&l);
+
+        out.resize(texels * texels);
+        for (int ty = 0; ty < texels; ty++)
+            for (int tx = 0; tx < texels; tx++) {
+                float px = area.x + (tx + 0.5f) * LIGHTMAP_TEXEL, py = area.y + (ty + 0.5f) * LIGHTMAP_TEXEL;
+                float r = ambient.r, g = ambient.g, b = ambient.b;
+                for (const Light* l : reaching) {
+                    float dx = px - l->position.x, dy = py - l->position.y;
+                    float d2 = dx*dx + dy*dy;
+                    if (d2 >= l->radius * l->radius) continue;
+                    float f = 1.0f - sqrtf(d2) / l->radius;
+                    f *= f * l->intensity;
+                    r += l->color.r * f;
+                    g += l->color.g * f;
+                    b += l->color.b * f;
+                }
+                out[ty * texels + tx] = { (unsigned char)std::min(r, 255.0f), (unsigned char)std::min(g, 255.0f), (unsigned char)std::min(b, 255.0f), 255 };
+            }
+    }
+
+    void drawGlow(Vector2 position, float radius, Color color, float intensity) {
+        color.a = (unsigned char)(std::clamp(intensity, 0.0f, 1.0f) * 255);
+        DrawTexturePro(glow, Rectangle{ 0, 0, (float)glow.width, (float)glow.height },
+            Rectangle{ position.x - radius, position.y - radius, radius * 2, radius * 2 }, {0,0}, 0, color);
+    }
+
+    // Before the scene is drawn, texture modes can't nest
+    void render(const Camera2D& camera, const std::pmr::vector<Light>& lights, Vector2 torch, float torchRadius) {
+        if (!enabled) return;
+        if (!buffer.id) {
+            buffer = loadRenderTexture(GAME_WIDTH / LIGHT_BUFFER_SCALE, GAME_HEIGHT / LIGHT_BUFFER_SCALE, VRAM_LIGHTING);
+            SetTextureFilter(buffer.texture, TEXTURE_FILTER_BILINEAR);
+            Image image = GenImageGradientRadial(64, 64, 0.0f, WHITE, BLANK);
+            glow = loadTextureFromImage(image, VRAM_LIGHTING);
+            UnloadImage(image);
+            SetTextureFilter(glow, TEXTURE_FILTER_BILINEAR);
+        }
+
+        Camera2D view = camera;
+        view.offset = { camera.offset.x / LIGHT_BUFFER_SCALE, camera.offset.y / LIGHT_BUFFER_SCALE };
+        view.zoom = camera.zoom / LIGHT_BUFFER_SCALE;
+        const float chunkPx = LIGHT_CHUNK_TILES * tileSize;
+
+        BeginTextureMode(buffer);
+        ClearBackground(ambient);
+        BeginMode2D(view);
+        Rectangle visible = cameraView(camera);
+        for (Chunk& c : chunks) {
+            Rectangle area = { c.cx * chunkPx, c.cy * chunkPx, chunkPx, chunkPx };
+            if (!CheckCollisionRecs(area, visible)) continue;
+            DrawTexturePro(c.texture, Rectangle{ 0, 0, (float)c.texture.width, (float)c.texture.height },
+                area, {0,0}, 0, WHITE);
+        }
+
+        BeginBlendMode(BLEND_ADDITIVE);
+        float t = (float)GetTime();
+        size_t drawn = 0;
+        for (const Light& l : lights) {
+            if (!l.flicker) continue;
+            if (drawn++ == MAX_DYNAMIC_LIGHTS) break;
+            float flicker = 0.85f + 0.15f * sinf(t * 11.0f + l.position.x) * sinf(t * 7.3f + l.position.y);
+            drawGlow(l.position, l.radius, l.color, l.intensity * flicker);
+        }
+        if (torchRadius > 0.0f)
+            drawGlow(torch, torchRadius, TORCH_COLOR, 1.0f);
+        EndBlendMode();
+        EndMode2D();
+        EndTextureMode();
+    }
+
+    // Screen space, the buffer is all opaque so multiplied blending is a plain product
+    void composite() {
+        if (!enabled || !buffer.id) return;
+        BeginBlendMode(BLEND_MULTIPLIED);
+        DrawTexturePro(buffer.texture, Rectangle{ 0, 0, (float)buffer.texture.width, -(float)buffer.texture.height },
+            Rectangle{ 0, 0, (float)GAME_WIDTH, (float)GAME_HEIGHT }, {0,0}, 0, WHITE);
+        EndBlendMode();
+    }
+};
+
+enum ParticleEffectId { PARTICLE_FIRE, PARTICLE_SPRAY, PARTICLE_DUST, PARTICLE_EFFECT_COUNT };
+
+struct ParticleEffect {
+    const char* name;               // "effect" property of the emitter object
+    float minLife, maxLife;         // Seconds
+    float minSpeed, maxSpeed;       // World pixels per second
+    float angle, spread;            // Launch direction and half cone, radians
+    Vector2 accel;
+    float startSize, endSize;
+    Color startColor, endColor;
+    bool additive;
+    int sprite;                     // Region of the particle atlas
+};
+
+const ParticleEffect PARTICLE_EFFECTS[PARTICLE_EFFECT_COUNT] = {
+    { "fire",  0.4f, 0.9f, 20.0f, 45.0f, -PI/2, 0.35f, { 0.0f, -30.0f }, 6.0f, 2.0f, { 255, 180, 60, 255 }, { 200, 40, 10, 0 }, true, 0 },
+    { "spray", 0.5f, 1.2f, 60.0f, 120.0f, -PI/2, 0.8f, { 0.0f, 260.0f }, 3.0f, 2.0f, { 200, 230, 255, 220 }, { 170, 210, 255, 0 }, false, 0 },
+    { "dust",  2.0f, 4.0f, 4.0f, 12.0f, 0.0f, PI, { 0.0f, -2.0f }, 3.0f, 3.0f, { 255, 255, 220, 160 }, { 255, 255, 220, 0 }, false, 1 },
+};
+
+const int PARTICLE_SPRITE_SIZE = 8;
+const int PARTICLE_LANES = 8;                       // Pool capacity is a multiple of this, one AVX register of floats
+const float PARTICLE_CULL_MARGIN = 64.0f;           // Emitters this close to the view keep spawning
+
+// From a Tiled object in the Particles layer
+struct ParticleEmitter {
+    int effect;
+    Rectangle area;                 // Spawn area in world pixels, a point for point objects
+    float rate;                     // Particles per second
+    int max;                        // Share of the effect pool, spawning stops while this many are alive
+    float pending = 0.0f;           // Fractional particles carried to the next frame
+    int live = 0;
+};
+
+// Every particle of one effect, structure of arrays so the update loops are straight float streams with no
+// per-particle branching. Arrays come from the level arena at map load and are never resized
+struct ParticlePool {
+    int effect;
+    int count = 0, capacity = 0;
+    float *x, *y, *vx, *vy, *age, *life;
+    int* owner;                     // Index into ParticleSystem::emitters
+    uint32_t seed = 0x9E3779B9u;
+
+    float random01() {              // xorshift32, no locks or global state
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    }
+
+    void spawn(ParticleEmitter& e, int emitter) {
+        if (count == capacity || e.live >= e.max) return;
+        const ParticleEffect& fx = PARTICLE_EFFECTS[effect];
+        float angle = fx.angle + (random01() * 2.0f - 1.0f) * fx.spread;
+        float speed = fx.minSpeed + random01() * (fx.maxSpeed - fx.minSpeed);
+        int i = count++;
+        x[i] = e.area.x + random01() * e.area.width;
+        y[i] = e.area.y + random01() * e.area.height;
+        vx[i] = cosf(angle) * speed;
+        vy[i] = sinf(angle) * speed;
+        age[i] = 0.0f;
+        life[i] = fx.minLife + random01() * (fx.maxLife - fx.minLife);
+        owner[i] = emitter;
+        e.live++;
+    }
+
+    // Whole lanes of PARTICLE_LANES through restrict pointers, so the compiler may assume the streams never alias.
+    // Slots past count are padding and integrating them is harmless
+    void update(float dt, ParticleEmitter* emitters) {
+        const Vector2 a = PARTICLE_EFFECTS[effect].accel;
+        for (int lane = 0; lane < count; lane += PARTICLE_LANES) {
+            float* __restrict px = x + lane;
+            float* __restrict py = y + lane;
+            float* __restrict pvx = vx + lane;
+            float* __restrict pvy = vy + lane;
+            float* __restrict page = age + lane;
+            for (int k = 0; k < PARTICLE_LANES; k++) {
+                pvx[k] += a.x * dt;
+                pvy[k] += a.y * dt;
+                px[k] += pvx[k] * dt;
+                py[k] += pvy[k] * dt;
+                page[k] += dt;
+            }
+        }
+        // Dead ones are replaced by the last live particle, order doesn't matter
+        for (int i = 0; i < count; ) {
+            if (age[i] < life[i]) {
+                i++;
+                continue;
+            }
+            emitters[owner[i]].live--;
+            count--;
+            x[i] = x[count];
+            y[i] = y[count];
+            vx[i] = vx[count];
+            vy[i] = vy[count];
+            age[i] = age[count];
+            life[i] = life[count];
+            owner[i] = owner[count];
+        }
+    }
+};
+
+// Emitters and pools for the current map. Every particle is a quad from one small generated atlas, so a pool
+// draws as one batch (raylib only splits it when its vertex buffer fills up)
+struct ParticleSystem {
+    std::pmr::vector<ParticleEmitter> emitters;
+    std::pmr::vector<ParticlePool> pools;
+    Texture2D atlas = {};
+
+    explicit ParticleSystem(std::pmr::memory_resource* resource) : emitters(resource), pools(resource) { }
+
+    ~ParticleSystem() {
+        if (atlas.id) unloadTexture(atlas);
+    }
+
+    // One pool per effect in use, sized by the max of its emitters. The only allocations of the system
+    void build(std::pmr::memory_resource* resource) {
+        pools.clear();
+        int capacity[PARTICLE_EFFECT_COUNT] = {};
+        for (ParticleEmitter& e : emitters) {
+            capacity[e.effect] += e.max;
+            e.live = 0;
+        }
+        for (int fx = 0; fx < PARTICLE_EFFECT_COUNT; fx++) {
+            if (!capacity[fx]) continue;
+            ParticlePool& pool = pools.emplace_back();
+            pool.effect = fx;
+            pool.capacity = capacity[fx];
+            pool.seed += fx * 7919;
+            int padded = (capacity[fx] + PARTICLE_LANES - 1) / PARTICLE_LANES * PARTICLE_LANES;
+            float** arrays[] = { &pool.x, &pool.y, &pool.vx, &pool.vy, &pool.age, &pool.life };
+            for (float** a : arrays) {
+                *a = (float*)resource->allocate(padded * sizeof(float), 32);
+                std::fill(*a, *a + padded, 0.0f);
+            }
+            pool.owner = (int*)resource->allocate(padded * sizeof(int), 32);
+            std::fill(pool.owner, pool.owner + padded, 0);
+        }
+    }
+
+    ParticlePool* poolFor(int effect) {
+        for (ParticlePool& p : pools)
+            if (p.effect == effect) return &p;
+        return nullptr;
+    }
+
+    void update(float dt, const Rectangle& view) {
+        Rectangle near = { view.x - PARTICLE_CULL_MARGIN, view.y - PARTICLE_CULL_MARGIN,
+                           view.width + 2 * PARTICLE_CULL_MARGIN, view.height + 2 * PARTICLE_CULL_MARGIN };
+        for (int i = 0; i < (int)emitters.size(); i++) {
+            ParticleEmitter& e = emitters[i];
+            if (!e.max || !CheckCollisionRecs({ e.area.x, e.area.y, std::max(e.area.width, 1.0f), std::max(e.area.height, 1.0f) }, near)) {
+                e.pending = 0.0f;
+                continue;
+            }
+            ParticlePool* pool = poolFor(e.effect);
+            e.pending += e.rate * dt;
+            for (; e.pending >= 1.0f; e.pending -= 1.0f)
+                pool->spawn(e, i);
+        }
+        for (ParticlePool& pool : pools)
+            pool.update(dt, emitters.data());
+    }
+
+    void draw(const Rectangle& view) {
+        if (pools.empty()) return;
+        if (!atlas.id) {
+            Image image = GenImageColor(2 * PARTICLE_SPRITE_SIZE, PARTICLE_SPRITE_SIZE, BLANK);
+            Image dot = GenImageGradientRadial(PARTICLE_SPRITE_SIZE, PARTICLE_SPRITE_SIZE, 0.0f, WHITE, BLANK);
+            ImageDraw(&image, dot, Rectangle{ 0, 0, (float)PARTICLE_SPRITE_SIZE, (float)PARTICLE_SPRITE_SIZE },
+                Rectangle{ 0, 0, (float)PARTICLE_SPRITE_SIZE, (float)PARTICLE_SPRITE_SIZE }, WHITE);
+            ImageDrawRectangle(&image, PARTICLE_SPRITE_SIZE, 0, PARTICLE_SPRITE_SIZE, PARTICLE_SPRITE_SIZE, WHITE);
+            atlas = loadTextureFromImage(image, VRAM_PARTICLES);
+            UnloadImage(dot);
+            UnloadImage(image);
+        }
+
+        for (ParticlePool& pool : pools) {
+            const ParticleEffect& fx = PARTICLE_EFFECTS[pool.effect];
+            Rectangle src = { (float)(fx.sprite * PARTICLE_SPRITE_SIZE), 0, (float)PARTICLE_SPRITE_SIZE, (float)PARTICLE_SPRITE_SIZE };
+            BeginBlendMode(fx.additive ? BLEND_ADDITIVE : BLEND_ALPHA);
+            for (int i = 0; i < pool.count; i++) {
+                float t = pool.age[i] / pool.life[i];
+                float size = fx.startSize + (fx.endSize - fx.startSize) * t;
+                if (pool.x[i] + size < view.x || pool.y[i] + size < view.y ||
+                    pool.x[i] - size > view.x + view.width || pool.y[i] - size > view.y + view.height) continue;
+                Color c = {
+                    (unsigned char)(fx.startColor.r + (fx.endColor.r - fx.startColor.r) * t),
+                    (unsigned char)(fx.startColor.g + (fx.endColor.g - fx.startColor.g) * t),
+                    (unsigned char)(fx.startColor.b + (fx.endColor.b - fx.startColor.b) * t),
+                    (unsigned char)(fx.startColor.a + (fx.endColor.a - fx.startColor.a) * t)
+                };
+                DrawTexturePro(atlas, src, Rectangle{ pool.x[i] - size/2, pool.y[i] - size/2, size, size }, {0,0}, 0, c);
+            }
+            EndBlendMode();
+        }
+    }
+};
+
+const float PARALLAX_TEXEL = 2.0f;                  // World pixels per baked texel, tilesets are 16px art drawn at 32px
+const int PARALLAX_MAX_TEXELS = 4096;               // Per side, bigger layers stay ordinary tile layers
+
+// Tile layers with a Tiled parallax factor (or a "scrollx"/"scrolly" drift) are composed once at load into a
+// texture at the art's own resolution. The texture repeats, so the layer's size is the period it wraps at,
+// and every frame each layer is a single quad covering the view with its source rect shifted by the camera
+struct ParallaxLayer {
+    Vector2 factor;                 // Tiled parallaxx/parallaxy
+    Vector2 offset;                 // Tiled offsetx/offsety, world pixels
+    Vector2 scroll;                 // Drift in world pixels per second
+    bool foreground;                // Listed after the first regular tile layer, drawn over the world
+    Texture2D texture;
+};
+
+struct Parallax {
+    std::vector<ParallaxLayer> layers;
+    Vector2 origin = { 0, 0 };      // Tiled parallaxoriginx/parallaxoriginy, where layers line up with the map
+
+    ~Parallax() {
+        release();
+    }
+
+    void release() {
+        for (ParallaxLayer& l : layers)
+            unloadTexture(l.texture);
+        layers.clear();
+    }
+
+    // Same shift as the Tiled editor, (view center - origin) * (1 - factor), snapped to whole world pixels
+    void draw(Rectangle view, Vector2 center, bool foreground) {
+        float t = (float)GetTime();
+        for (ParallaxLayer& l : layers) {
+            if (l.foreground != foreground) continue;
+            float w = l.texture.width * PARALLAX_TEXEL, h = l.texture.height * PARALLAX_TEXEL;
+            float x = view.x - l.offset.x - (center.x - origin.x) * (1.0f - l.factor.x) - l.scroll.x * t;
+            float y = view.y - l.offset.y - (center.y - origin.y) * (1.0f - l.factor.y) - l.scroll.y * t;
+            x = floorf(x - floorf(x / w) * w);
+            y = floorf(y - floorf(y / h) * h);
+            DrawTexturePro(l.texture, Rectangle{ x / PARALLAX_TEXEL, y / PARALLAX_TEXEL, view.width / PARALLAX_TEXEL, view.height / PARALLAX_TEXEL },
+                view, {0,0}, 0, WHITE);
+        }
+    }
+};
+
+const float NPC_SPRITE_MARGIN = 6.0f * tileSize;           // Sheets start loading this far outside the view
+const float NPC_SPRITE_KEEP_MARGIN = 12.0f * tileSize;      // and count as out of range past this
+const float NPC_SPRITE_EVICT_SECONDS = 10.0f;               // Out of range this long unloads the sheet
+
+// NPC spritesheets are decoded on a worker the first time the NPC comes near the view, and uploaded on the
+// main thread. A shadow placeholder is drawn until then. Sheets that stay out of range are unloaded again,
+// so VRAM follows what's around the camera instead of the whole population. Jobs carry the level
+// generation, images decoded for a level that's gone are dropped
+struct NpcSprites {
+    struct Job {
+        int npc;
+        uint32_t generation;
+        std::string path;
+    };
+
+    struct Done {
+        int npc;
+        uint32_t generation;
+        Image image;
+    };
+
+    Texture2D placeholder = {};
+    uint32_t generation = 0;
+    int loadedCount = 0;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    std::vector<Done> done, uploads;                        // Swapped every frame, no allocations once warm
+    bool quit = false;
+
+    ~NpcSprites() {
+        stop();
+        for (Done& d : done)
+            UnloadImage(d.image);
+        if (placeholder.id) unloadTexture(placeholder);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+
+    void workerLoop() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !jobs.empty(); });
+                if (quit) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            Image image = LoadImage(job.path.c_str());
+            std::lock_guard<std::mutex> lock(mutex);
+            done.push_back({ job.npc, job.generation, image });
+        }
+    }
+
+    // A soft shadow where the feet go, same size as an LPC frame
+    Texture2D* placeholderTexture() {
+        if (!placeholder.id) {
+            Image image = GenImageColor(64, 64, BLANK);
+            ImageDrawCircle(&image, 32, 58, 9, Fade(BLACK, 0.3f));
+            placeholder = loadTextureFromImage(image, VRAM_CHARACTERS);
+            UnloadImage(image);
+        }
+        return &placeholder;
+    }
+
+    void request(int npc, const std::string& path) {
+        if (!worker.joinable())
+            worker = std::thread(&NpcSprites::workerLoop, this);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({ npc, generation, path });
+        }
+        wake.notify_one();
+    }
+
+    void unloadSheet(NPC& npc) {
+        if (npc.texture.id) {
+            unloadTexture(npc.texture);
+            loadedCount--;
+        }
+        npc.texture.id = 0;
+        npc.spriteState = SPRITE_UNLOADED;
+    }
+
+    // The level is going away, queued jobs are forgotten and late results ignored
+    void release(std::pmr::vector<NPC>& npcs) {
+        generation++;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.clear();
+        }
+        for (NPC& npc : npcs)
+            unloadSheet(npc);
+    }
+
+    void update(std::pmr::vector<NPC>& npcs, Rectangle view, float dt) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uploads.swap(done);
+        }
+        for (Done& d : uploads) {
+            if (d.generation == generation && d.npc < (int)npcs.size() && npcs[d.npc].spriteState == SPRITE_LOADING) {
+                NPC& npc = npcs[d.npc];
+                if (d.image.data) {
+                    npc.texture = loadTextureFromImage(d.image, VRAM_CHARACTERS);
+                    npc.spriteState = SPRITE_LOADED;
+                    loadedCount++;
+                }
+                else
+                    npc.spriteState = SPRITE_FAILED;
+            }
+            if (d.image.data) UnloadImage(d.image);
+        }
+        uploads.clear();
+
+        Rectangle near = { view.x - NPC_SPRITE_MARGIN, view.y - NPC_SPRITE_MARGIN,
+                           view.width + 2 * NPC_SPRITE_MARGIN, view.height + 2 * NPC_SPRITE_MARGIN };
+        Rectangle keep = { view.x - NPC_SPRITE_KEEP_MARGIN, view.y - NPC_SPRITE_KEEP_MARGIN,
+                           view.width + 2 * NPC_SPRITE_KEEP_MARGIN, view.height + 2 * NPC_SPRITE_KEEP_MARGIN };
+        for (size_t i = 0; i < npcs.size(); i++) {
+            NPC& npc = npcs[i];
+            Rectangle sprite = { npc.x, npc.y - (npc.spriteH - tileSize), npc.spriteW, npc.spriteH };
+            npc.spriteIdle = CheckCollisionRecs(sprite, keep) ? 0.0f : npc.spriteIdle + dt;
+            if (npc.spriteState == SPRITE_UNLOADED && CheckCollisionRecs(sprite, near)) {
+                npc.spriteState = SPRITE_LOADING;
+                request((int)i, RESOURCE_PATH + nameOf(npc.name) + ".png");
+            }
+            else if (npc.spriteState == SPRITE_LOADED && npc.spriteIdle > NPC_SPRITE_EVICT_SECONDS)
+                unloadSheet(npc);
+        }
+    }
+};
+
+enum TelemetryScopeId {
+    SCOPE_LOADMAP, SCOPE_RELOAD, SCOPE_SAVE, SCOPE_EVENT, SCOPE_DIALOGUE, SCOPE_NPCS, SCOPE_PARTICLES, SCOPE_RENDER,
+    SCOPE_COUNT
+};
+
+const char* const SCOPE_NAMES[] = { "loadMap", "reload", "save", "event", "dialogue", "npcs", "particles", "render" };
+const char* const STATE_NAMES[] = { "normal", "transition", "dialogue", "event", "rewind" };
+const int STATE_COUNT = STATE_REWIND + 1;
+const std::string TELEMETRY_PATH = "./telemetry.log";
+const float HITCH_FRAMES = 2.0f;                    // A frame longer than this many pacing intervals is a hitch
+const int HITCH_RECENT = 32;                        // Hitches listed one by one in the summary
+
+// Streaming log-linear histogram of frame times in microseconds, HDR histogram style: exact below 64 us,
+// then 32 buckets per power of two (about 3% error) up to half an hour. Fixed size, recording is a few shifts
+struct FrameHistogram {
+    static const int EXACT = 64;
+    static const int SUB = 32;
+    static const int BUCKETS = EXACT + 25 * SUB;
+
+    uint32_t counts[BUCKETS] = {};
+    uint64_t total = 0;
+    uint32_t max = 0;
+
+    static int bucket(uint32_t us) {
+        if (us < EXACT) return us;
+        int k = std::bit_width(us) - 1;             // 6 and up
+        int shift = k - 5;
+        return std::min(EXACT + (k - 6) * SUB + (int)(us >> shift) - SUB, BUCKETS - 1);
+    }
+
+    // Middle of the bucket
+    static double value(int b) {
+        if (b < EXACT) return b;
+        int k = (b - EXACT) / SUB + 6, shift = k - 5;
+        return (double)(((uint64_t)(SUB + (b - EXACT) % SUB) << shift) + ((1ull << shift) >> 1));
+    }
+
+    void record(double seconds) {
+        uint32_t us = (uint32_t)std::min(seconds * 1e6, 4e9);
+        counts[bucket(us)]++;
+        total++;
+        max = std::max(max, us);
+    }
+
+    double percentile(double p) const {
+        if (total == 0) return 0.0;
+        uint64_t rank = (uint64_t)ceil(p * total), seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= std::max<uint64_t>(rank, 1)) return std::min(value(b), (double)max);
+        }
+        return max;
+    }
+};
+
+// Always-on frame timing: one histogram per GameState, plus per-frame time in a few subsystem scopes.
+// A hitch is tagged with the scope that took longest that frame (or "other" when none stands out,
+// GPU or OS stalls) and the map, event or dialogue it was working on. Summarized to a text file at exit
+struct Telemetry {
+    struct Hitch {
+        double time;                                // GetTime() at the end of the frame
+        int state;
+        float frame, scopeTime;                     // Seconds
+        int scope;                                  // SCOPE_COUNT for other
+        NameId detail;
+    };
+
+    FrameHistogram states[STATE_COUNT];
+    float scopeTime[SCOPE_COUNT] = {};
+    NameId scopeDetail[SCOPE_COUNT] = {};
+    int hitchCount[SCOPE_COUNT + 1] = {};
+    float hitchWorst[SCOPE_COUNT + 1] = {};
+    Hitch recent[HITCH_RECENT];
+    int recentCount = 0, recentHead = 0;
+    uint64_t frames = 0;
+    double startTime = -1.0;
+
+    void add(int scope, NameId detail, double seconds) {
+        scopeTime[scope] += (float)seconds;
+        if (detail != NO_NAME) scopeDetail[scope] = detail;
+    }
+
+    // frame is 0 until the pacer has seen two presents
+    void endFrame(int state, double frame, double interval) {
+        if (startTime < 0.0) startTime = GetTime();
+        if (frame > 0.0) {
+            frames++;
+            states[state].record(frame);
+        }
+
+        if (frame > interval * HITCH_FRAMES) {
+            int scope = SCOPE_COUNT;
+            float longest = 0.0f;
+            for (int i = 0; i < SCOPE_COUNT; i++)
+                if (scopeTime[i] > longest) {
+                    longest = scopeTime[i];
+                    scope = i;
+                }
+            if (longest < frame * 0.25f) scope = SCOPE_COUNT;     // Nothing measured explains the frame
+            hitchCount[scope]++;
+            hitchWorst[scope] = std::max(hitchWorst[scope], (float)frame);
+            recent[recentHead] = { GetTime(), state, (float)frame, scope < SCOPE_COUNT ? longest : 0.0f, scope,
+                scope < SCOPE_COUNT ? scopeDetail[scope] : NO_NAME };
+            recentHead = (recentHead + 1) % HITCH_RECENT;
+            recentCount = std::min(recentCount + 1, HITCH_RECENT);
+        }
+
+        std::fill(std::begin(scopeTime), std::end(scopeTime), 0.0f);
+        std::fill(std::begin(scopeDetail), std::end(scopeDetail), NO_NAME);
+    }
+
+    static const char* scopeName(int scope) {
+        return scope < SCOPE_COUNT ? SCOPE_NAMES[scope] : "other";
+    }
+
+    void writeSummary(const std::string& path) const {
+        std::ofstream f(path);
+        if (!f) {
+            TraceLog(LOG_WARNING, "TELEMETRY: Could not write %s", path.c_str());
+            return;
+        }
+        f << TextFormat("Frame telemetry: %llu frames in %.1f s\n\n", (unsigned long long)frames, startTime < 0.0 ? 0.0 : GetTime() - startTime);
+        f << TextFormat("%-12s %8s %8s %8s %8s %8s  (ms)\n", "state", "frames", "p50", "p95", "p99", "max");
+        for (int st = 0; st < STATE_COUNT; st++) {
+            const FrameHistogram& h = states[st];
+            if (h.total == 0) continue;
+            f << TextFormat("%-12s %8llu %8.2f %8.2f %8.2f %8.2f\n", STATE_NAMES[st], (unsigned long long)h.total,
+                h.percentile(0.50) / 1000.0, h.percentile(0.95) / 1000.0, h.percentile(0.99) / 1000.0, h.max / 1000.0);
+        }
+
+        f << "\nHitches by scope\n";
+        for (int i = 0; i <= SCOPE_COUNT; i++)
+            if (hitchCount[i] > 0)
+                f << TextFormat("%-12s %8d   worst %8.2f ms\n", scopeName(i), hitchCount[i], hitchWorst[i] * 1000.0f);
+
+        f << "\nRecent hitches\n";
+        for (int n = 0; n < recentCount; n++) {
+            const Hitch& hi = recent[(recentHead - recentCount + n + HITCH_RECENT) % HITCH_RECENT];
+            f << TextFormat("%9.2f s  %-10s %8.2f ms  %s", hi.time, STATE_NAMES[hi.state], hi.frame * 1000.0f, scopeName(hi.scope));
+            if (hi.scope < SCOPE_COUNT)
+                f << TextFormat(" %.2f ms", hi.scopeTime * 1000.0f);
+            if (hi.detail != NO_NAME)
+                f << " " << nameOf(hi.detail);
+            f << "\n";
+        }
+        TraceLog(LOG_INFO, "TELEMETRY: Wrote %s", path.c_str());
+    }
+};
+
+Telemetry telemetry;
+
+// Time from construction to the end of the block is charged to the scope for this frame
+struct TelemetryScope {
+    int scope;
+    NameId detail;
+    double start;
+
+    TelemetryScope(int scope_, NameId detail_ = NO_NAME) : scope(scope_), detail(detail_), start(GetTime()) { }
+    ~TelemetryScope() { telemetry.add(scope, detail, GetTime() - start); }
+};
+
+// Level data of the current map. Nothing is freed until the next map load rewinds the whole arena.
+// The backing block grows to the biggest map seen, so later loads are pointer bumps without touching the heap
+struct LevelArena : std::pmr::memory_resource {
+    std::unique_ptr<std::byte[]> block;
+    size_t blockSize = 0;
+    std::optional<std::pmr::monotonic_buffer_resource> pool;
+    size_t used = 0;                // Bytes handed out since the last reset
+    size_t allocations = 0;
+
+    LevelArena() { grow(256 * 1024); }
+
+    void reset() {
+        size_t peak = used;
+        pool.reset();
+        if (peak > blockSize) grow(peak + peak / 4);
+        else pool.emplace(block.get(), blockSize);
+        used = 0;
+        allocations = 0;
+    }
+
+    void grow(size_t size) {
+        MemoryScope scope(MEM_LEVEL);
+        pool.reset();
+        block.reset(new std::byte[size]);
+        blockSize = size;
+        pool.emplace(block.get(), blockSize);
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        used += bytes;
+        allocations++;
+        return pool->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override { }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+const float MOVE_SKIN = 0.01f;              // Pixels of overlap still treated as touching, float error after a clamp
+
+// Time of impact in [0, 1] of a box moving by delta against a static one, 2 when it misses. axis is the one the
+// hit happened on, 0 for x and 1 for y. Boxes already overlapping deeper than MOVE_SKIN don't block, so
+// anything spawned or pushed into a collider can still walk out of it
+float sweptAabb(Rectangle box, Vector2 delta, Rectangle other, int& axis) {
+    const float pos[2] = { box.x, box.y }, size[2] = { box.width, box.height };
+    const float opos[2] = { other.x, other.y }, osize[2] = { other.width, other.height };
+    const float d[2] = { delta.x, delta.y };
+    float entry[2], exit[2];
+    for (int i = 0; i < 2; i++) {
+        if (d[i] == 0.0f) {
+            if (pos[i] + size[i] <= opos[i] || pos[i] >= opos[i] + osize[i]) return 2.0f;
+            entry[i] = -INFINITY;
+            exit[i] = INFINITY;
+        }
+        else if (d[i] > 0.0f) {
+            entry[i] = (opos[i] - (pos[i] + size[i])) / d[i];
+            exit[i] = (opos[i] + osize[i] - pos[i]) / d[i];
+        }
+        else {
+            entry[i] = (opos[i] + osize[i] - pos[i]) / d[i];
+            exit[i] = (opos[i] - (pos[i] + size[i])) / d[i];
+        }
+    }
+    axis = entry[0] > entry[1] ? 0 : 1;
+    float t = entry[axis], out = std::min(exit[0], exit[1]);
+    if (t >= out || t > 1.0f || out <= 0.0f) return 2.0f;
+    if (t < 0.0f) {
+        if (t * fabs(d[axis]) < -MOVE_SKIN) return 2.0f;
+        t = 0.0f;
+    }
+    return t;
+}
+
+struct Map {
+    LevelArena arena;                           // Declared first so it outlives everything allocated from it
+
+    std::pmr::vector<TileLayer> layers{&arena};
+    std::vector<Tileset> tilesets;
+    std::pmr::vector<std::pmr::vector<int>> collisions{&arena};
+    std::pmr::vector<SpriteAtlas> atlases{&arena};          // Tilesets first (same index), then characters
+    std::pmr::vector<RenderItem> staticDrawables{&arena};   // Sorted once at load
+    std::vector<RenderItem> dynamicDrawables;               // Player and NPCs, rebuilt every frame
+    int renderOriginX = 0, renderOriginY = 0;               // World pixels RenderItem positions are relative to
+    std::pmr::vector<WorldObject> worldObjects{&arena};
+    std::pmr::vector<Transition> transitions{&arena};
+    std::pmr::vector<SpawnPoint> spawnPoints{&arena};
+    std::pmr::vector<DialoguePoint> dialoguePoints{&arena};
+    std::pmr::vector<NPC> npcs{&arena};
+    std::pmr::vector<EventPoint> eventPoints{&arena};
+    std::pmr::vector<Event> events{&arena};
+    std::pmr::vector<Light> lights{&arena};
+    ParticleSystem particles{&arena};
+    NpcSprites npcSprites;
+    int placeholderAtlas = 0;                   // Drawn for NPCs whose spritesheet isn't loaded yet
+
+    // Hashed name lookups, rebuilt on every load
+    std::pmr::unordered_map<NameId, int> npcIndex{&arena}, eventIndex{&arena};
+
+    bool infinite = false;
+    ChunkStreamer streamer;                     // Only used by infinite maps
+    PathService pathing;
+    uint32_t navGeneration = 0;
+    TilemapRenderer tileRenderer;               // Only used by finite maps
+    Lighting lighting;
+    Parallax parallax;                          // Only used by finite maps
+    Color background = BLUE;                    // Tiled "backgroundcolor"
+    bool lit = false;                           // Map has lights or an "ambient" property, flat WHITE otherwise
+    Color ambientLight = WHITE;
+    float torchRadius = 0.0f;                   // World pixels, "torch" map property in tiles
+
+    NameId mapName = NO_NAME;
+    NameId playerSpawnName;
+    SpawnPoint playerSpawn;
+    int height, width = 0;
+
+    std::vector<Rectangle> debugColliders;
+    std::vector<Rectangle> moveColliders;       // Scratch for move(), reused by every mover
+
+    std::vector<std::string> pendingReloads;    // Files written since they could last be applied
+
+    Map() { }
+
+    ~Map() {
+        for (Tileset& ts : tilesets)
+            unloadTexture(ts.texture);
+    }
+
+    void loadMap(NameId map, NameId spawn) {
+        TelemetryScope scope(SCOPE_LOADMAP, map);
+        MemoryScope memoryScope(MEM_LEVEL);
+        memoryWindow.peak = memoryWindow.current.load();
+        const std::string& filename = nameOf(map);
+        mapName = map;
+        playerSpawnName = spawn;
+        releaseLevel();
+        buildLevel(nullptr);
+        TraceLog(LOG_INFO, "MAP: %s level data uses %zu bytes in %zu allocations", filename.c_str(), arena.used, arena.allocations);
+        recordMemory();
+    }
+
+    // Every stage of the current map into a freshly rewound arena. Infinite maps stream around center, or the
+    // spawn point when it's null
+    void buildLevel(const Vector2* center) {
+        const std::string& filename = nameOf(mapName);
+        loadFromTMJ(RESOURCE_PATH + filename + ".tmj");
+        buildTileRenderer();
+        lighting.bake(lights, ambientLight, lit);
+        if (infinite) {
+            streamer.start(center ? *center : Vector2{ playerSpawn.x, playerSpawn.y });
+            rebuildStreamedDrawables();
+        }
+        else {
+            loadCollisions((RESOURCE_PATH + filename + "_Collisions.csv").c_str());
+            loadStaticDrawables();
+        }
+        buildNavigation();
+        loadNpcs();
+        loadEvents((RESOURCE_PATH + filename + "_events.json").c_str());
+    }
+
+    void recordMemory() {
+        const std::string& name = nameOf(mapName);
+        auto it = std::find_if(mapMemory.begin(), mapMemory.end(), [&](const MapMemory& m) { return m.map == name; });
+        MapMemory& m = (it != mapMemory.end()) ? *it : mapMemory.emplace_back();
+        m.map = name;
+        for (int c = 0; c < MEM_CATEGORY_COUNT; c++)
+            m.cpu[c] = memoryCounters[c].current;
+        for (int c = 0; c < VRAM_CATEGORY_COUNT; c++)
+            m.vram[c] = vram.current[c];
+        m.arenaUsed = arena.used;
+        m.loadPeak = memoryWindow.peak;
+        memoryBudgets.checkAll();
+    }
+
+    // Swaps every arena container with an empty one (deallocation is a no-op), then rewinds the arena
+    template <typename C>
+    static void drop(C& c) {
+        C(c.get_allocator()).swap(c);
+    }
+
+    void releaseLevel() {
+        npcSprites.release(npcs);
+        drop(layers);
+        drop(collisions);
+        drop(atlases);
+        drop(staticDrawables);
+        drop(worldObjects);
+        drop(transitions);
+        drop(spawnPoints);
+        drop(dialoguePoints);
+        drop(npcs);
+        drop(eventPoints);
+        drop(events);
+        drop(lights);
+        drop(particles.emitters);
+        drop(particles.pools);
+        drop(npcIndex);
+        drop(eventIndex);
+        arena.reset();
+    }
+
+    // Hot reload. Live state (player, NPC positions, triggered events) is kept
+    void queueReload(const std::string& file) {
+        if (std::find(pendingReloads.begin(), pendingReloads.end(), file) == pendingReloads.end())
+            pendingReloads.push_back(file);
+    }
+
+    void applyReloads(Player& player) {
+        if (pendingReloads.empty() || gameState == STATE_TRANSITION || gameState == STATE_REWIND) return;    // pendingTransition points into transitions
+        TelemetryScope scope(SCOPE_RELOAD, mapName);
+        MemoryScope memoryScope(MEM_LEVEL);
+        const std::string& filename = nameOf(mapName);
+        std::vector<std::string> deferred;
+        std::vector<std::string> levelFiles;
+        for (const std::string& file : pendingReloads) {
+            double start = GetTime();
+            if (file == filename + ".tmj" || file == filename + "_events.json" || (file == filename + "_Collisions.csv" && !infinite)) {
+                // A running script or the open dialogue points into the NPCs and events the rebuild replaces
+                if (player.ongoingEvent || gameState == STATE_EVENT || gameState == STATE_DIALOGUE)
+                    deferred.push_back(file);
+                else
+                    levelFiles.push_back(file);
+                continue;
+            }
+            else if (endsWith(file, DialogueDB::sourceSuffix(dialogueDB.language))) {
+                if (gameState == STATE_DIALOGUE) {          // The open dialogue points into the table
+                    deferred.push_back(file);
+                    continue;
+                }
+                reloadDialogues();
+            }
+            else continue;                                  // Not part of the current map
+            TraceLog(LOG_INFO, "MAP: Reloaded %s in %.2f ms", file.c_str(), (GetTime() - start) * 1000.0);
+        }
+        if (!levelFiles.empty()) {
+            double start = GetTime();
+            reloadLevel(player);
+            for (const std::string& file : levelFiles)
+                TraceLog(LOG_INFO, "MAP: Reloaded %s", file.c_str());
+            TraceLog(LOG_INFO, "MAP: Level rebuilt in %.2f ms, %zu bytes of arena", (GetTime() - start) * 1000.0, arena.used);
+        }
+        pendingReloads.swap(deferred);
+    }
+
+    // The arena is only ever rewound as a whole, so any level file rebuilds the whole level instead of refilling
+    // containers in place, which would stack another level's worth of allocations on every save. NPC positions
+    // go through the world state like on a map transition, triggered events come back from the world flags
+    void reloadLevel(Player& player) {
+        storeNpcs();
+        releaseLevel();
+        Vector2 center = { player.x, player.y };
+        buildLevel(&center);
+        player.atlas = addSpriteAtlas<LpcSheet>(&player.texture);
+    }
+
+    // Every map's dialogues live in one table, rebuilding it moves them so NPCs look theirs up again
+    void reloadDialogues() {
+        std::vector<NameId> npcDialogues;
+        for (NPC& npc : npcs)
+            npcDialogues.push_back(npc.dialogue ? npc.dialogue->name : NO_NAME);
+
+        dialogueDB.load(dialogueDB.language, true);
+
+        for (size_t i = 0; i < npcs.size(); i++)
+            npcs[i].dialogue = (npcDialogues[i] != NO_NAME) ? findDialogue(npcDialogues[i]) : nullptr;
+    }
+
+    void finishEvent(Event& ev) {
+        ev.triggered = true;
+        world.setFlag(ev.flag, 1);
+    }
+
+    // Where NPCs were left survives map transitions and saves
+    void storeNpcs() {
+        for (NPC& npc : npcs)
+            world.storeNpc(mapName, npc.name, npc.x, npc.y, npc.direction);
+    }
+
+    void loadFromTMJ(const std::string& filename) {
+        // Textures of tilesets still in use are kept, reloads and maps sharing tilesets don't hit the disk for them
+        std::unordered_multimap<std::string, Texture2D> oldTextures;
+        for (Tileset& ts : tilesets)
+            oldTextures.emplace(ts.image, ts.texture);
+
+        layers.clear();
+        tilesets.clear();
+        worldObjects.clear();
+        transitions.clear();
+        spawnPoints.clear();
+        dialoguePoints.clear();
+        eventPoints.clear();
+        lights.clear();
+        particles.emitters.clear();
+        parallax.release();
+
+        // Infinite maps keep their chunks in a pack next to the .tmj, rebuilt whenever the .tmj changes
+        streamer.stop();
+        long modTime = GetFileModTime(filename.c_str());
+        std::string packPath = filename.substr(0, filename.find_last_of('.')) + ".chunks";
+        bool packReady = streamer.open(packPath, modTime);
+
+        json j = packReady ? loadJsonSkipping(filename, "chunks") : loadJson(filename);
+        infinite = j.value("infinite", false);
+        if (infinite && !packReady) {
+            ChunkStreamer::writePack(packPath, modTime, j);
+            streamer.open(packPath, modTime);
+        }
+        int collisionFirstGid = 0;
+
+        // Load tilesets
+        for (json forTileset : j["tilesets"]) {
+            json jsonTileset;
+            // .tsj
+            std::string imgPath;
+            if (forTileset.contains("source")) {
+                std::string tsjRelative = forTileset["source"];
+                std::string tsjPath = RESOURCE_PATH + tsjRelative;
+                jsonTileset = loadJson(tsjPath);
+                std::string tsjFolder = tsjRelative.substr(0, tsjRelative.find_last_of("/\\") + 1);
+                imgPath = RESOURCE_PATH + tsjFolder + jsonTileset["image"].get<std::string>();
+            }
+            // .png
+            else {
+                jsonTileset = forTileset;
+                imgPath = RESOURCE_PATH + jsonTileset["image"].get<std::string>();
+            }
+                
+            Texture2D tex;
+            auto old = oldTextures.find(imgPath);
+            if (old != oldTextures.end()) {
+                tex = old->second;
+                oldTextures.erase(old);
+            }
+            else {
+                tex = loadTexture(imgPath.c_str(), VRAM_TILESETS);
+                SetTextureFilter(tex, TEXTURE_FILTER_POINT);
+            }
+
+            Tileset tileset;
+            tileset.texture = tex;
+            tileset.image = imgPath;
+            tileset.firstGid   = forTileset["firstgid"].get<int>();
+            tileset.tileWidth  = jsonTileset["tilewidth"].get<int>();
+            tileset.tileHeight = jsonTileset["tileheight"].get<int>();
+            tileset.columns    = jsonTileset["columns"].get<int>();
+            if (jsonTileset.value("name", "") == "collisions")
+                collisionFirstGid = tileset.firstGid;
+
+            // Animations
+            if (jsonTileset.contains("tiles")) {
+                for (json tile : jsonTileset["tiles"]) {
+                    if (!tile.contains("animation")) continue;
+
+                    int tileId = tile["id"].get<int>();
+
+                    for (json frame : tile["animation"]) {
+                        tileset.animations[tileId].push_back({
+                            frame["tileid"].get<int>(),
+                            frame["duration"].get<int>()
+                        });
+                    }
+                }
+            }
+
+            tilesets.push_back(tileset);
+        }
+        for (auto& [path, tex] : oldTextures)
+            unloadTexture(tex);
+
+        atlases.clear();
+        for (Tileset& ts : tilesets) {
+            SpriteAtlas& atlas = atlases.emplace_back();
+            atlas.texture = &ts.texture;
+            int rows = ts.texture.height / ts.tileHeight;
+            atlas.frames.reserve(ts.columns * rows);
+            for (int localId = 0; localId < ts.columns * rows; localId++)
+                atlas.frames.push_back({
+                    {
+                        (float)((localId % ts.columns) * ts.tileWidth),
+                        (float)((localId / ts.columns) * ts.tileHeight),
+                        (float)ts.tileWidth,
+                        (float)ts.tileHeight
+                    },
+                    (float)tileSize, (float)tileSize
+                });
+        }
+
+        background = parseTiledColor(j.value("backgroundcolor", ""), BLUE);
+        parallax.origin = { j.value("parallaxoriginx", 0.0f) * 2.0f, j.value("parallaxoriginy", 0.0f) * 2.0f };
+        std::vector<std::optional<Image>> parallaxArt(tilesets.size());     // Loaded on first use, freed after the layers
+        bool regularLayerSeen = false;
+        double parallaxStart = GetTime();
+
+        // Load layers
+        for (json layer : j["layers"]) {
+            if (layer["type"] == "tilelayer") {
+                if (layer["name"] == "Collisions") continue;        //Ignore collisions, they are parsed separately
+
+                ParallaxLayer pl = {
+                    { layer.value("parallaxx", 1.0f), layer.value("parallaxy", 1.0f) },
+                    { layer.value("offsetx", 0.0f) * 2.0f, layer.value("offsety", 0.0f) * 2.0f },
+                    { 0, 0 }, regularLayerSeen, {}
+                };
+                for (json property : layer.value("properties", json::array())) {
+                    if (property["name"] == "scrollx")
+                        pl.scroll.x = property["value"].get<float>() * 2.0f;
+                    else if (property["name"] == "scrolly")
+                        pl.scroll.y = property["value"].get<float>() * 2.0f;
+                }
+                if (pl.factor.x != 1.0f || pl.factor.y != 1.0f || pl.scroll.x != 0.0f || pl.scroll.y != 0.0f) {
+                    std::string name = layer["name"].get<std::string>();
+                    if (infinite)
+                        TraceLog(LOG_WARNING, "PARALLAX: Layer %s is drawn as a normal layer, infinite maps don't support parallax", name.c_str());
+                    else {
+                        int w = layer["width"].get<int>(), h = layer["height"].get<int>();
+                        std::vector<int> gids = readTileData(layer, layer.value("encoding", "csv"), layer.value("compression", ""), w * h);
+                        if (bakeParallax(gids, w, h, parallaxArt, pl.texture)) {
+                            parallax.layers.push_back(pl);
+                            continue;
+                        }
+                        TraceLog(LOG_WARNING, "PARALLAX: Layer %s is too large to bake, drawn as a normal layer", name.c_str());
+                    }
+                }
+                regularLayerSeen = true;
+
+                TileLayer& tlayer = layers.emplace_back();
+                tlayer.name   = intern(layer["name"].get<std::string>());
+                tlayer.width  = layer["width"].get<int>();
+                tlayer.height = layer["height"].get<int>();
+                if (!infinite)                                      // Chunks are streamed, see ChunkStreamer
+                    tlayer.data.assign(readTileData(layer, layer.value("encoding", "csv"), layer.value("compression", ""), tlayer.width * tlayer.height),
+                                       tlayer.width, tlayer.height);
+            }
+            else if (layer["type"] == "objectgroup") {
+
+                if (layer["name"] == LAYER_WORLDOBJECTS) {
+                    for (json obj : layer["objects"]) {
+                        if (!obj.contains("properties")) continue;
+                        WorldObject wo;
+                        for (json property : obj["properties"]) {
+                            if (property["name"] == "endX")
+                                wo.endX = property["value"].get<int>();
+                            else if (property["name"] == "endY")
+                                wo.endY = property["value"].get<int>();
+                            else if (property["name"] == "layer")
+                                wo.layer = intern(property["value"].get<std::string>());
+                            else if (property["name"] == "startX")
+                                wo.startX = property["value"].get<int>();
+                            else if (property["name"] == "startY")
+                                wo.startY = property["value"].get<int>();
+                        }
+                        wo.x = obj["x"].get<int>() / 16;
+                        wo.y = obj["y"].get<int>() / 16;
+                        worldObjects.push_back(wo);
+                    }
+                }
+
+                else if (layer["name"] == LAYER_TRANSITIONS) {
+                    for (json obj : layer["objects"]) {
+                        if (!obj.contains("properties")) continue;
+                        Transition t;
+                        for (json property : obj["properties"]) {
+                            if (property["name"] == "map")
+                                t.map = intern(property["value"].get<std::string>());
+                            else if (property["name"] == "spawnName")
+                                t.spawnName = intern(property["value"].get<std::string>());
+                        }
+                        t.trigger = {
+                            obj["x"].get<float>() * 2.0f,           // Go from 16px tiles to 32px tiles
+                            obj["y"].get<float>() * 2.0f,
+                            obj["width"].get<float>() * 2.0f,
+                            obj["height"].get<float>() * 2.0f
+                        };
+                        transitions.push_back(t);
+                    }
+                }
+
+                else if (layer["name"] == LAYER_SPAWNPOINTS) {
+                    for (json obj : layer["objects"]) {
+                        if (!obj.contains("properties")) continue;
+                        SpawnPoint sp;
+                        for (json property : obj["properties"]) {
+                            if (property["name"] == "who")
+                                sp.who = property["value"].get<std::string>();
+                            else if (property["name"] == "name")
+                                sp.name = intern(property["value"].get<std::string>());
+                            else if (property["name"] == "frame")
+                                sp.frame = property["value"].get<std::string>();
+                            else if (property["name"] == "dialogue")
+                                sp.dialogue = intern(property["value"].get<std::string>());
+                            else if (property["name"] == "behaviour") {
+                                std::string behaviour = property["value"].get<std::string>();
+                                if (behaviour == "idle") sp.behaviour = BEHAVIOUR_IDLE;
+                                if (behaviour == "wander") sp.behaviour = BEHAVIOUR_WANDER;
+                            }
+                            else if (property["name"] == "radius")
+                                sp.radius = property["value"].get<int>();
+                        }
+                        sp.x = obj["x"].get<float>() * 2.0f;
+                        sp.y = obj["y"].get<float>() * 2.0f;
+                        sp.x -= 16.0f;                          //Small offset accounting for ~16 blank pixels on most spritesheets
+                        if (sp.who == "player") {
+                            if (sp.name == playerSpawnName)
+                                playerSpawn = sp;
+                            continue;
+                        }
+                        spawnPoints.push_back(sp);
+                    }
+                }
+
+                else if (layer["name"] == LAYER_DIALOGUES) {
+                    for (json obj : layer["objects"]) {
+                        if (!obj.contains("properties")) continue;
+                        DialoguePoint dp;
+                        for (json property : obj["properties"]) {
+                            if (property["name"] == "src")
+                                dp.src = intern(property["value"].get<std::string>());
+                        }
+                        dp.trigger = {
+                            obj["x"].get<float>() * 2.0f,           // Go from 16px tiles to 32px tiles
+                            obj["y"].get<float>() * 2.0f,
+                            obj["width"].get<float>() * 2.0f,
+                            obj["height"].get<float>() * 2.0f
+                        };
+                        dialoguePoints.push_back(dp);
+                    }
+                }
+
+                else if (layer["name"] == LAYER_EVENTS) {
+                    for (json obj : layer["objects"]) {
+                        if (!obj.contains("properties")) continue;
+                        EventPoint ep;
+                        for (json property : obj["properties"]) {
+                            if (property["name"] == "name")
+                                ep.name = intern(property["value"].get<std::string>());
+                        }
+                        ep.trigger = {
+                            obj["x"].get<float>() * 2.0f,           // Go from 16px tiles to 32px tiles
+                            obj["y"].get<float>() * 2.0f,
+                            obj["width"].get<float>() * 2.0f,
+                            obj["height"].get<float>() * 2.0f
+                        };
+                        eventPoints.push_back(ep);
+                    }
+                }
+
+                else if (layer["name"] == LAYER_LIGHTS) {
+                    for (json obj : layer["objects"]) {
+                        Light light = { {}, 4.0f * tileSize, TORCH_COLOR, 1.0f, false };
+                        for (json property : obj.value("properties", json::array())) {
+                            if (property["name"] == "radius")
+                                light.radius = property["value"].get<float>() * tileSize;        // In tiles
+                            else if (property["name"] == "color")
+                                light.color = parseTiledColor(property["value"].get<std::string>(), light.color);
+                            else if (property["name"] == "intensity")
+                                light.intensity = property["value"].get<float>();
+                            else if (property["name"] == "flicker")
+                                light.flicker = property["value"].get<bool>();
+                        }
+                        light.position = {                                                      // Points, or the center of ellipses
+                            (obj["x"].get<float>() + obj.value("width", 0.0f) / 2.0f) * 2.0f,
+                            (obj["y"].get<float>() + obj.value("height", 0.0f) / 2.0f) * 2.0f
+                        };
+                        lights.push_back(light);
+                    }
+                }
+
+                else if (layer["name"] == LAYER_PARTICLES) {
+                    for (json obj : layer["objects"]) {
+                        ParticleEmitter e = { -1, {}, 20.0f, 256 };
+                        for (json property : obj.value("properties", json::array())) {
+                            if (property["name"] == "effect") {
+                                std::string effect = property["value"].get<std::string>();
+                                for (int fx = 0; fx < PARTICLE_EFFECT_COUNT; fx++)
+                                    if (effect == PARTICLE_EFFECTS[fx].name) e.effect = fx;
+                            }
+                            else if (property["name"] == "rate")
+                                e.rate = property["value"].get<float>();
+                            else if (property["name"] == "max")
+                                e.max = std::max(0, property["value"].get<int>());
+                        }
+                        if (e.effect < 0) {
+                            TraceLog(LOG_WARNING, "PARTICLES: Emitter %d has no known effect", obj.value("id", 0));
+                            continue;
+                        }
+                        e.area = {
+                            obj["x"].get<float>() * 2.0f,
+                            obj["y"].get<float>() * 2.0f,
+                            obj.value("width", 0.0f) * 2.0f,
+                            obj.value("height", 0.0f) * 2.0f
+                        };
+                        particles.emitters.push_back(e);
+                    }
+                }
+            }
+        }
+
+        for (std::optional<Image>& art : parallaxArt)
+            if (art && art->data) UnloadImage(*art);
+        if (!parallax.layers.empty())
+            TraceLog(LOG_INFO, "PARALLAX: Baked %zu layers in %.2f ms", parallax.layers.size(), (GetTime() - parallaxStart) * 1000.0);
+
+        particles.build(&arena);
+
+        // Lighting is opt-in per map
+        lit = !lights.empty();
+        ambientLight = DEFAULT_AMBIENT;
+        float torchTiles = DEFAULT_TORCH_TILES;
+        for (json property : j.value("properties", json::array())) {
+            if (property["name"] == "ambient") {
+                ambientLight = parseTiledColor(property["value"].get<std::string>(), DEFAULT_AMBIENT);
+                lit = true;
+            }
+            else if (property["name"] == "torch")
+                torchTiles = property["value"].get<float>();
+        }
+        torchRadius = lit ? torchTiles * tileSize : 0.0f;
+
+        if (!layers.empty()) {
+            width = layers[0].width;
+            height = layers[0].height;
+        }
+
+        if (infinite) {
+            streamer.collisionFirstGid = collisionFirstGid;
+            streamer.worldObjects.assign(worldObjects.begin(), worldObjects.end());
+            streamer.tilesetFirstGids.clear();
+            for (Tileset& ts : tilesets)
+                streamer.tilesetFirstGids.push_back(ts.firstGid);
+        }
+    }
+
+    void updateStreaming(Vector2 center) {
+        if (!infinite) return;
+        streamer.update(center);
+        if (streamer.changed) rebuildStreamedDrawables();
+    }
+
+    // Infinite maps move the render origin to the camera's chunk, so positions stay small however far out it is
+    void rebuildStreamedDrawables() {
+        renderOriginX = streamer.centerX * streamer.chunkWidth * tileSize;
+        renderOriginY = streamer.centerY * streamer.chunkHeight * tileSize;
+        staticDrawables.clear();
+        for (auto& [key, chunk] : streamer.resident) {
+            int dx = chunk->cx * streamer.chunkWidth * tileSize - renderOriginX;
+            int dy = chunk->cy * streamer.chunkHeight * tileSize - renderOriginY;
+            for (RenderItem item : chunk->drawables) {
+                item.x = (int16_t)(item.x + dx);
+                item.y = (int16_t)(item.y + dy);
+                staticDrawables.push_back(item);
+            }
+        }
+        std::sort(staticDrawables.begin(), staticDrawables.end(),
+            [](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
+        streamer.changed = false;
+    }
+
+    void loadCollisions(const char* filename) {
+        collisions.clear();
+
+        std::ifstream file(filename);
+        std::string line;
+
+        while (std::getline(file, line)) {
+            std::pmr::vector<int>& row = collisions.emplace_back();
+            std::string cell;
+
+            for (char c : line) {
+                if (c == ',') {
+                    row.push_back(std::stoi(cell));
+                    cell.clear();
+                    continue;
+                } 
+                cell += c;
+            }
+            row.push_back(std::stoi(cell));
+        }
+    }
+
+    void buildTileRenderer() {
+        if (infinite)
+            tileRenderer.release();
+        else
+            tileRenderer.build(tilesets, layers);
+    }
+
+    // Walkable grid and HPA* graph handed to the path worker. Streamed maps have no grid, their requests fail
+    void buildNavigation() {
+        MemoryScope scope(MEM_NAVIGATION);
+        if (infinite || collisions.empty()) {
+            pathing.setNav(nullptr);
+            return;
+        }
+        double start = GetTime();
+        auto nav = std::make_shared<NavData>();
+        nav->generation = ++navGeneration;
+        nav->grid.height = (int)collisions.size();
+        nav->grid.width = (int)collisions[0].size();
+        nav->grid.walkable.assign(nav->grid.width * nav->grid.height, 0);
+
+        // Colliders can be shifted up to a tile into their neighbours, so a cell is walkable when an NPC body
+        // standing on it clears every collider around, the same test Map::move enforces
+        NPC probe;
+        for (int y = 0; y < nav->grid.height; y++)
+            for (int x = 0; x < nav->grid.width && x < (int)collisions[y].size(); x++) {
+                if (collisions[y][x] != -1) continue;
+                Vector2 position = npcPositionAt({ x, y });
+                probe.x = position.x;
+                probe.y = position.y;
+                probe.updateBody();
+                bool clear = true;
+                for (int ny = y - 1; ny <= y + 1 && clear; ny++)
+                    for (int nx = x - 1; nx <= x + 1 && clear; nx++) {
+                        int col = collisionValue(nx, ny);
+                        if (col != -1 && CheckCollisionRecs(probe.body, getTileCollider(nx, ny, col)))
+                            clear = false;
+                    }
+                nav->grid.walkable[y * nav->grid.width + x] = clear;
+            }
+        nav->hpa.build(nav->grid);
+        TraceLog(LOG_INFO, "PATH: %dx%d grid, %zu HPA* nodes built in %.2f ms", nav->grid.width, nav->grid.height,
+            nav->hpa.nodes.size(), (GetTime() - start) * 1000.0);
+        pathing.setNav(std::move(nav));
+    }
+
+    // Drawable index per tile of one layer, so anchoring doesn't have to search
+    struct DrawableGrid {
+        int width, height;
+        std::vector<int> cells;         // -1 where the layer has no drawable
+
+        int at(int x, int y) const {
+            if (x < 0 || y < 0 || x >= width || y >= height) return -1;
+            return cells[y * width + x];
+        }
+    };
+
+    void loadStaticDrawables() {
+        std::vector<Drawable> drawables;
+        std::unordered_map<NameId, DrawableGrid> grids;
+
+        for (TileLayer& layer : layers) {
+            if (layer.name != NAME_DRAWABLES) continue;
+
+            DrawableGrid& grid = grids[layer.name];
+            grid.width = layer.width;
+            grid.height = layer.height;
+            grid.cells.assign(layer.width * layer.height, -1);
+
+            layer.data.forEach([&](int x, int y, int gid) {
+                Tileset* ts = findTileset(gid);
+                if (!ts) return;
+
+                Rectangle dst = {
+                    (float)(x * tileSize),
+                    (float)(y * tileSize),
+                    (float)tileSize,
+                    (float)tileSize
+                };
+
+                Drawable d;
+                d.atlas = ts - tilesets.data();
+                d.frame = gid - ts->firstGid;
+                d.dst = dst;
+                d.sortY = dst.y + dst.height;
+
+                d.x = x;
+                d.y = y;
+                d.layer = layer.name;
+                if (grid.cells[y * layer.width + x] == -1)
+                    grid.cells[y * layer.width + x] = drawables.size();
+                drawables.push_back(d);
+            });
+        }
+
+        // Update sortY to match object anchor, one grid lookup per covered tile
+        for (WorldObject& wo : worldObjects) {
+            auto it = grids.find(wo.layer);
+            if (it == grids.end()) continue;
+            const DrawableGrid& grid = it->second;
+
+            int anchorIndex = grid.at(wo.x, wo.y);
+            if (anchorIndex == -1) continue;
+            int anchor = drawables[anchorIndex].sortY;
+
+            for (int y = wo.startY+wo.y; y < wo.endY+wo.y+1; y++)
+                for (int x = wo.startX+wo.x; x < wo.endX+wo.x+1; x++) {
+                    int index = grid.at(x, y);
+                    if (index != -1)
+                        drawables[index].sortY = anchor;
+                }
+        }
+
+        renderOriginX = renderOriginY = 0;
+        if (std::max(width, height) > RENDER_RANGE_TILES)
+            TraceLog(LOG_WARNING, "MAP: %dx%d is past the %d tiles drawables can reach, make it infinite instead",
+                width, height, RENDER_RANGE_TILES);
+        staticDrawables.clear();
+        staticDrawables.reserve(drawables.size());
+        for (Drawable& dr : drawables)
+            staticDrawables.push_back({
+                renderKey(dr.sortY, staticDrawables.size()),
+                (int16_t)dr.dst.x, (int16_t)dr.dst.y,
+                (uint16_t)dr.atlas, (uint16_t)dr.frame
+            });
+        std::sort(staticDrawables.begin(), staticDrawables.end(),
+            [](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
+    }
+
+    // Character spritesheets are laid out as a columns x rows grid, frame = row * columns + column
+    int addSpriteAtlas(Texture2D* texture, int columns, int rows) {
+        SpriteAtlas& atlas = atlases.emplace_back();
+        atlas.texture = texture;
+        float w = (float)texture->width / columns;
+        float h = (float)texture->height / rows;
+        atlas.frames.reserve(columns * rows);
+        for (int row = 0; row < rows; row++)
+            for (int col = 0; col < columns; col++)
+                atlas.frames.push_back({ {col * w, row * h, w, h}, w, h });
+        return atlases.size() - 1;
+    }
+
+    // Same for a compile-time sheet layout, its rect table is only scaled when the texture isn't at nominal size
+    template <typename Sheet>
+    int addSpriteAtlas(Texture2D* texture) {
+        SpriteAtlas& atlas = atlases.emplace_back();
+        atlas.texture = texture;
+        float sx = (float)texture->width / (Sheet::columns * Sheet::frameSize);
+        float sy = (float)texture->height / (Sheet::rows * Sheet::frameSize);
+        atlas.frames.reserve(Sheet::rects.size());
+        for (const Rectangle& r : Sheet::rects)
+            atlas.frames.push_back({ {r.x * sx, r.y * sy, r.width * sx, r.height * sy}, r.width * sx, r.height * sy });
+        return atlases.size() - 1;
+    }
+
+    void loadNpcs() {
+        npcs.clear();
+        npcIndex.clear();
+        for (SpawnPoint& sp : spawnPoints) {
+            if (sp.who != "npc")
+                continue;
+            if (sp.dialogue != NO_NAME) {
+                const Dialogue* dia = findDialogue(sp.dialogue);
+                if (!dia) continue;
+                npcs.emplace_back();
+                npcs.back().buildNpc(sp.frame, sp.name, sp.x, sp.y, dia);
+            }
+            else {
+                npcs.emplace_back();
+                npcs.back().buildNpc(sp.frame, sp.name, sp.x, sp.y);
+            }
+            npcIndex.emplace(sp.name, (int)npcs.size() - 1);
+
+            NPC& spawned = npcs.back();
+            GridPoint home = npcTile(spawned);
+            spawned.behaviour = sp.behaviour;
+            spawned.homeX = home.x;
+            spawned.homeY = home.y;
+            spawned.wanderRadius = sp.radius;
+
+            if (const SavedNpc* saved = world.findNpc(mapName, sp.name)) {
+                NPC& npc = npcs.back();
+                npc.x = saved->x;
+                npc.y = saved->y;
+                npc.direction = saved->direction;
+                npc.updateBody();
+            }
+        }
+
+        for (NPC& npc : npcs)
+            npc.atlas = addSpriteAtlas<LpcSheet>(&npc.texture);
+        placeholderAtlas = addSpriteAtlas(npcSprites.placeholderTexture(), 1, 1);
+    }
+
+    const Dialogue* findDialogue(NameId name) {
+        return dialogueDB.find(mapName, name);
+    }
+
+    NPC* findNpc(NameId name) {
+        auto it = npcIndex.find(name);
+        return (it != npcIndex.end()) ? &npcs[it->second] : nullptr;
+    }
+
+    Event* findEvent(NameId name) {
+        auto it = eventIndex.find(name);
+        return (it != eventIndex.end()) ? &events[it->second] : nullptr;
+    }
+
+    EventAction parseAction(const json& a) {
+        EventAction action(events.get_allocator());
+        std::string str_type = a["type"].get<std::string>();
+        EventActionType type = ACTION_DIALOGUE;                     // Should never keep this, but compiler will throw warning if it's not there
+        if (str_type == "ACTION_DIALOGUE") type = ACTION_DIALOGUE;
+        if (str_type == "ACTION_MOVE_NPC") type = ACTION_MOVE_NPC;
+        if (str_type == "ACTION_MOVE_CAMERA") type = ACTION_MOVE_CAMERA;
+        if (str_type == "ACTION_MOVE_PLAYER") type = ACTION_MOVE_PLAYER;
+        if (str_type == "ACTION_GROUP") type = ACTION_GROUP;
+        if (str_type == "ACTION_WAIT") type = ACTION_WAIT;
+        if (str_type == "ACTION_PATH_NPC") type = ACTION_PATH_NPC;
+        action.type = type;
+        if ((type == ACTION_MOVE_CAMERA) || (type == ACTION_MOVE_NPC) || (type == ACTION_MOVE_PLAYER)) {
+            action.tiles = a["tiles"].get<int>();
+            std::string str_direction = a["direction"].get<std::string>();
+            int direction = RIGHT;                                              // Again, should never keep this value
+            if (str_direction == "RIGHT") direction = RIGHT;
+            if (str_direction == "LEFT") direction = LEFT;
             if (str_direction == "UP") direction = UP;
             if (str_direction == "DOWN") direction = DOWN;
             action.direction = direction;
         }
-        if (type == ACTION_MOVE_NPC) {
-            std::string str_npc = a["npc"].get<std::string>();
-            NPC* npc = nullptr;
-            for (NPC& n : npcs)
-                if (n.name == str_npc)
-                    npc = &n;
-            action.npc = npc;
-            action.follow = a["follow"].get<bool>();
+        if (type == ACTION_MOVE_NPC) {
+            action.npc = findNpc(intern(a["npc"].get<std::string>()));
+            action.follow = a["follow"].get<bool>();
+        }
+        if (type == ACTION_PATH_NPC) {
+            action.npc = findNpc(intern(a["npc"].get<std::string>()));
+            action.targetX = a["x"].get<int>();
+            action.targetY = a["y"].get<int>();
+            action.follow = a["follow"].get<bool>();
+        }
+        if (type == ACTION_MOVE_PLAYER)
+            action.follow = a["follow"].get<bool>();
+        if (type == ACTION_DIALOGUE)
+            action.dialogue = intern(a["dialogue"].get<std::string>());
+        if (type == ACTION_MOVE_CAMERA)
+            action.speed = a["speed"].get<float>();
+        if (type == ACTION_GROUP)
+            for (json sub : a["actions"])
+                action.subactions.push_back(parseAction(sub));
+        if (type == ACTION_WAIT)
+            action.seconds = a["seconds"].get<float>();
+        return action;
+    }
+
+    void loadEvents(const char* filename) {
+        events.clear();
+        eventIndex.clear();
+
+        json j = loadJson(filename);
+        
+        for (json e : j["events"]) {
+            Event ev(events.get_allocator());
+            ev.name = intern(e["name"].get<std::string>());
+            ev.flag = intern(nameOf(mapName) + "/" + nameOf(ev.name));
+            ev.triggered = world.flag(ev.flag) != 0;
+            for (json a : e["actions"]) {
+                ev.actions.push_back(parseAction(a));
+            }
+            eventIndex.emplace(ev.name, (int)events.size());
+            events.push_back(std::move(ev));
+        }
+    }
+
+    int collisionValue(int tx, int ty) {
+        if (infinite)
+            return streamer.collisionAt(tx, ty);
+        if (tx < 0 || ty < 0 || ty >= height || tx >= width)
+            return true; // Outside the map
+        return collisions[ty][tx];
+    }
+
+    Rectangle getTileCollider(int tx, int ty, int col) {
+        //0 DOWN, 1 UP, 2 RIGHT, 3 LEFT
+
+        if (col < 32*1) {
+            return Rectangle{
+                tx * tileSize + 0.0f,
+                ty * tileSize + col + 0.0f,
+                tileSize,
+                tileSize
+            };
+        }
+        else if (col < 32*2) {
+            col = col % 32;
+            return Rectangle{
+                tx * tileSize + 0.0f,
+                ty * tileSize - col + 0.0f,
+                tileSize,
+                tileSize
+            };
+        }
+        else if (col < 32*3) {
+            col = col % 32;
+            return Rectangle{
+                tx * tileSize + col + 0.0f,
+                ty * tileSize + 0.0f,
+                tileSize,
+                tileSize
+            };
+        }
+        else if (col < 32*4) {
+            col = col % 32;
+            return Rectangle{
+                tx * tileSize - col + 0.0f,
+                ty * tileSize + 0.0f,
+                tileSize,
+                tileSize
+            };
+        }
+        else return Rectangle {};       // Error, should never happen
+    }
+
+    // Moves a body by delta against tiles, every NPC but self and an optional extra box. Colliders around the
+    // whole sweep are gathered once, the body stops at the first time of impact and what's left of the motion
+    // slides along the surface it hit. Returns how far the body actually moved
+    Vector2 move(Rectangle body, Vector2 delta, const NPC* self = nullptr, const Rectangle* extra = nullptr) {
+        if (delta.x == 0.0f && delta.y == 0.0f) return delta;
+        Rectangle sweep = {
+            std::min(body.x, body.x + delta.x), std::min(body.y, body.y + delta.y),
+            body.width + fabs(delta.x), body.height + fabs(delta.y)
+        };
+
+        // Tile colliders can be shifted up to a tile off their cell, see getTileCollider
+        moveColliders.clear();
+        int left   = (int)floor(sweep.x / tileSize) - 1;
+        int right  = (int)floor((sweep.x + sweep.width) / tileSize) + 1;
+        int top    = (int)floor(sweep.y / tileSize) - 1;
+        int bottom = (int)floor((sweep.y + sweep.height) / tileSize) + 1;
+        for (int y = top; y <= bottom; y++)
+            for (int x = left; x <= right; x++) {
+                int col = collisionValue(x, y);
+                if (col == -1) continue;
+                Rectangle tileCol = getTileCollider(x, y, col);
+                if (DEBUG_MODE) debugColliders.push_back(tileCol);
+                if (CheckCollisionRecs(sweep, tileCol)) moveColliders.push_back(tileCol);
+            }
+        for (const NPC& npc : npcs)
+            if (&npc != self && CheckCollisionRecs(sweep, npc.body)) moveColliders.push_back(npc.body);
+        if (extra && CheckCollisionRecs(sweep, *extra)) moveColliders.push_back(*extra);
+
+        // After a hit only one axis is left, so two passes resolve any step
+        Vector2 moved = { 0.0f, 0.0f };
+        for (int pass = 0; pass < 2 && (delta.x != 0.0f || delta.y != 0.0f); pass++) {
+            float toi = 1.0f;
+            int axis = -1;
+            for (const Rectangle& c : moveColliders) {
+                int hitAxis;
+                float t = sweptAabb(body, delta, c, hitAxis);
+                if (t < toi) {
+                    toi = t;
+                    axis = hitAxis;
+                }
+            }
+            body.x += delta.x * toi;
+            body.y += delta.y * toi;
+            moved.x += delta.x * toi;
+            moved.y += delta.y * toi;
+            if (axis < 0) break;
+            delta = { axis == 0 ? 0.0f : delta.x * (1.0f - toi), axis == 1 ? 0.0f : delta.y * (1.0f - toi) };
+        }
+        return moved;
+    }
+
+    Tileset* findTileset(int gid) {
+        for (int i = tilesets.size() - 1; i >= 0; --i) {
+            if (gid >= tilesets[i].firstGid)
+                return &tilesets[i];
+        }
+        return nullptr;
+    }
+
+    void drawTile(int gid, int x, int y) {
+        if (gid <= 0) return;
+
+        Tileset* ts = findTileset(gid);
+        if (!ts) return;
+
+        int localId = gid - ts->firstGid;
+
+        auto it = ts->animations.find(localId);
+        if (it != ts->animations.end()) {
+            std::vector<TileAnimationFrame> anim = it->second;
+
+            int totalTime = 0;
+            for (TileAnimationFrame f : anim) totalTime += f.duration;
+
+            if (totalTime > 0) {
+                int t = (int)(GetTime() * 1000) % totalTime;
+
+                int acc = 0;
+                for (TileAnimationFrame f : anim) {
+                    acc += f.duration;
+                    if (t < acc) {
+                        localId = f.tileId;
+                        break;
+                    }
+                }
+            }
+        }
+
+        Rectangle src = {
+            (float)((localId % ts->columns) * ts->tileWidth),
+            (float)((localId / ts->columns) * ts->tileHeight),
+            (float)ts->tileWidth,
+            (float)ts->tileHeight
+        };
+
+        Rectangle dst = {
+            (float)(x * tileSize),
+            (float)(y * tileSize),
+            (float)tileSize,
+            (float)tileSize
+        };
+
+        DrawTexturePro(ts->texture, src, dst, {0,0}, 0, WHITE);
+    }
+
+    // Composes a parallax layer on the CPU at art resolution, animated tiles keep their first frame
+    bool bakeParallax(const std::vector<int>& gids, int w, int h, std::vector<std::optional<Image>>& art, Texture2D& out) {
+        const int texel = (int)(tileSize / PARALLAX_TEXEL);
+        if (w * texel > PARALLAX_MAX_TEXELS || h * texel > PARALLAX_MAX_TEXELS) return false;
+
+        Image canvas = GenImageColor(w * texel, h * texel, BLANK);
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++) {
+                int gid = gids[y * w + x];
+                if (gid <= 0) continue;
+                Tileset* ts = findTileset(gid);
+                if (!ts) continue;
+
+                std::optional<Image>& image = art[ts - tilesets.data()];
+                if (!image) {
+                    image = LoadImage(ts->image.c_str());
+                    if (image->data) ImageFormat(&*image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+                }
+                if (!image->data) continue;
+
+                int localId = gid - ts->firstGid;
+                auto anim = ts->animations.find(localId);
+                if (anim != ts->animations.end() && !anim->second.empty())
+                    localId = anim->second[0].tileId;
+                Rectangle src = {
+                    (float)((localId % ts->columns) * ts->tileWidth),
+                    (float)((localId / ts->columns) * ts->tileHeight),
+                    (float)ts->tileWidth,
+                    (float)ts->tileHeight
+                };
+                ImageDraw(&canvas, *image, src, Rectangle{ (float)(x * texel), (float)(y * texel), (float)texel, (float)texel }, WHITE);
+            }
+
+        out = loadTextureFromImage(canvas, VRAM_PARALLAX);
+        UnloadImage(canvas);
+        SetTextureFilter(out, TEXTURE_FILTER_POINT);
+        SetTextureWrap(out, TEXTURE_WRAP_REPEAT);
+        return true;
+    }
+
+    void drawMap(bool altitude) {               // True for normal layers, false for topmost layers
+        if (infinite) {
+            drawStreamedMap(altitude);
+            return;
+        }
+
+        bool shader = SHADER_TILEMAP && tileRenderer.ready;
+        for (size_t i = 0; i < layers.size(); i++) {
+            TileLayer& layer = layers[i];
+            if (altitude && layer.name == NAME_ALWAYSABOVE) continue;
+            if (!altitude && layer.name != NAME_ALWAYSABOVE) continue;
+
+            if (shader)
+                tileRenderer.drawLayer(i, layer);
+            else
+                layer.data.forEach([this](int x, int y, int gid) { drawTile(gid, x, y); });
         }
-        if (type == ACTION_MOVE_PLAYER)
-            action.follow = a["follow"].get<bool>();
-        if (type == ACTION_DIALOGUE)
-            action.dialogue = a["dialogue"].get<std::string>();
-        if (type == ACTION_MOVE_CAMERA)
-            action.speed = a["speed"].get<float>();
-        if (type == ACTION_GROUP)
-            for (json sub : a["actions"])
-                action.subactions.push_back(parseAction(sub));
-        return action;
     }
 
-    void loadEvents(const char* filename) {
-        events.clear();
+    void drawStreamedMap(bool altitude) {
+        int cw = streamer.chunkWidth, ch = streamer.chunkHeight;
+        for (size_t li = 0; li < streamer.layerNames.size(); li++) {
+            if ((int)li == streamer.collisionLayer) continue;
+            NameId name = streamer.layerNames[li];
+            if (altitude && name == NAME_ALWAYSABOVE) continue;
+            if (!altitude && name != NAME_ALWAYSABOVE) continue;
+
+            for (auto& [key, chunk] : streamer.resident) {
+                int ox = chunk->cx * cw, oy = chunk->cy * ch;
+                chunk->layers[li].forEach([&](int x, int y, int gid) { drawTile(gid, ox + x, oy + y); });
+            }
+        }
+    }
 
-        json j = loadJson(filename);
-        
-        for (json e : j["events"]) {
-            Event ev;
-            ev.name = e["name"].get<std::string>();
-            // TODO: GESTIÓN DE TRIGGERED CON FLAGS GLOBALES QUE PERSISTAN A TRANSICIONES DE MAPA
-            for (json a : e["actions"]) {
-                ev.actions.push_back(parseAction(a));
+    void pushDynamic(float x, float y, float sortY, int atlas, int frame) {
+        uint32_t order = staticDrawables.size() + dynamicDrawables.size();
+        dynamicDrawables.push_back({ renderKey(sortY, order), (int16_t)(x - renderOriginX), (int16_t)(y - renderOriginY),
+            (uint16_t)atlas, (uint16_t)frame });
+    }
+
+    void submit(const RenderItem& item) {
+        SpriteAtlas& atlas = atlases[item.atlas];
+        const AtlasFrame& f = atlas.frames[item.frame];
+        DrawTexturePro(*atlas.texture, f.src,
+            Rectangle{ (float)(item.x + renderOriginX), (float)(item.y + renderOriginY), f.width, f.height }, {0,0}, 0, WHITE);
+    }
+
+    // Static items are already sorted, only the few dynamic ones are sorted per frame and merged in
+    void drawDrawables() {
+        std::sort(dynamicDrawables.begin(), dynamicDrawables.end(),
+            [](const RenderItem& a, const RenderItem& b) { return a.key < b.key; });
+
+        size_t i = 0, j = 0;
+        while (i < staticDrawables.size() || j < dynamicDrawables.size()) {
+            if (j == dynamicDrawables.size() || (i < staticDrawables.size() && staticDrawables[i].key < dynamicDrawables[j].key))
+                submit(staticDrawables[i++]);
+            else
+                submit(dynamicDrawables[j++]);
+        }
+    }
+};
+
+Camera2D setupCamera(Player &player) {
+    Camera2D camera = {0};
+    camera.target = { player.x + tileSize/2.0f, player.y + tileSize/2.0f };
+    camera.offset = { GAME_WIDTH/2.0f, GAME_HEIGHT/2.0f };
+    camera.rotation = 0.0f;
+    camera.zoom = 1.0f;
+    return camera;
+}
+
+enum PacingMode { PACING_VSYNC, PACING_CAP, PACING_UNCAPPED };
+
+const char* const PACING_NAMES[] = { "vsync", "cap", "uncapped" };
+const std::string CONFIG_PATH = "./config.json";
+
+// config.json first, then the command line on top: --pacing vsync|cap|uncapped, --fps N, --tick N,
+// --memory-report. An fps of 0 caps at the monitor's refresh rate. Memory budgets only come from "budgets"
+struct Settings {
+    int pacing = PACING_CAP;
+    int fps = 0;
+    int tickRate = DEFAULT_TICK_RATE;
+    bool memoryReport = false;          // Print memoryReport() at exit
+
+    bool setPacing(const std::string& name) {
+        for (int m = 0; m < 3; m++)
+            if (name == PACING_NAMES[m]) {
+                pacing = m;
+                return true;
+            }
+        TraceLog(LOG_WARNING, "CONFIG: Unknown pacing mode %s", name.c_str());
+        return false;
+    }
+
+    void load(const std::string& path) {
+        if (!FileExists(path.c_str())) return;
+        std::ifstream f(path);
+        json j = json::parse(f, nullptr, false);
+        if (j.is_discarded() || !j.is_object()) {
+            TraceLog(LOG_WARNING, "CONFIG: %s is not a JSON object, using defaults", path.c_str());
+            return;
+        }
+        if (j.contains("pacing") && j["pacing"].is_string()) setPacing(j["pacing"].get<std::string>());
+        if (j.contains("fps") && j["fps"].is_number_integer()) fps = std::max(0, j["fps"].get<int>());
+        if (j.contains("tick") && j["tick"].is_number_integer()) tickRate = std::max(1, j["tick"].get<int>());
+        if (j.contains("budgets") && j["budgets"].is_object()) memoryBudgets.load(j["budgets"]);
+    }
+
+    void parseArgs(int argc, char** argv) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--pacing" && hasValue) setPacing(argv[++i]);
+            else if (arg == "--fps" && hasValue) fps = std::max(0, atoi(argv[++i]));
+            else if (arg == "--tick" && hasValue) tickRate = std::max(1, atoi(argv[++i]));
+            else if (arg == "--memory-report") memoryReport = true;
+            else TraceLog(LOG_WARNING, "CONFIG: Ignoring argument %s", arg.c_str());
+        }
+    }
+};
+
+Settings settings;
+
+const double PACE_SPIN = 0.002;                     // Last stretch before a capped deadline is spun, sleeps overshoot
+const int PACE_SAMPLES = 120;                       // Frame intervals kept for the jitter stats
+
+// raylib's own cap is off, the pacer waits after EndDrawing instead. Capped frames sleep in 1 ms steps until
+// close to an absolute deadline and spin the rest, deadlines advance by the interval so errors don't add up.
+// Presents are timed on the steady clock. Jitter is the standard deviation of the intervals, and worst is
+// the largest distance from the target (from the mean when uncapped)
+struct FramePacer {
+    using Clock = std::chrono::steady_clock;
+
+    int mode = PACING_CAP;
+    int refreshRate = DEFAULT_FPS;
+    double interval = 1.0 / DEFAULT_FPS;            // Seconds, also the frame budget others plan against
+    Clock::time_point deadline, lastPresent;
+    bool started = false;
+
+    double samples[PACE_SAMPLES] = {};
+    int sampleCount = 0, sampleHead = 0;
+    double last = 0.0;                              // Latest present to present interval
+    double mean = 0.0, jitter = 0.0, worst = 0.0;
+
+    void begin(int mode_, int fps) {
+        mode = mode_;
+        int monitorRate = GetMonitorRefreshRate(GetCurrentMonitor());
+        refreshRate = monitorRate > 0 ? monitorRate : DEFAULT_FPS;
+        interval = 1.0 / ((mode == PACING_CAP && fps > 0) ? fps : refreshRate);
+        SetTargetFPS(0);
+        if (mode == PACING_VSYNC) SetWindowState(FLAG_VSYNC_HINT);
+        else ClearWindowState(FLAG_VSYNC_HINT);
+        started = false;
+        sampleCount = sampleHead = 0;
+        TraceLog(LOG_INFO, "PACING: %s at %.1f Hz (monitor %d Hz)", PACING_NAMES[mode], 1.0 / interval, refreshRate);
+    }
+
+    // Right after EndDrawing
+    void wait() {
+        if (mode == PACING_CAP && started) {
+            auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval));
+            deadline += step;
+            Clock::time_point now = Clock::now();
+            if (now > deadline + step)                  // Too far behind to catch up, start again from here
+                deadline = now;
+            auto spin = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(PACE_SPIN));
+            while (deadline - Clock::now() > spin)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            while (Clock::now() < deadline)
+                std::this_thread::yield();
+        }
+        record();
+    }
+
+    void record() {
+        Clock::time_point now = Clock::now();
+        if (!started) {
+            started = true;
+            deadline = lastPresent = now;
+            return;
+        }
+        last = std::chrono::duration<double>(now - lastPresent).count();
+        samples[sampleHead] = last;
+        sampleHead = (sampleHead + 1) % PACE_SAMPLES;
+        sampleCount = std::min(sampleCount + 1, PACE_SAMPLES);
+        lastPresent = now;
+
+        double sum = 0.0, sq = 0.0;
+        for (int i = 0; i < sampleCount; i++) {
+            sum += samples[i];
+            sq += samples[i] * samples[i];
+        }
+        mean = sum / sampleCount;
+        jitter = sqrt(std::max(0.0, sq / sampleCount - mean * mean));
+        double target = (mode == PACING_UNCAPPED) ? mean : interval;
+        worst = 0.0;
+        for (int i = 0; i < sampleCount; i++)
+            worst = std::max(worst, fabs(samples[i] - target));
+    }
+};
+
+FramePacer pacer;
+
+const float RESOLUTION_STEP = 0.5f;                 // Scale ladder step, 0.5 is the tilesets' own 16px resolution
+const int RESOLUTION_WINDOW = 30;                   // Frames per decision
+const float RESOLUTION_OVERRUN = 1.25f;             // Frame counts as late past this many budgets
+const float RESOLUTION_HEADROOM = 0.6f;             // Average work under this share of the budget allows a step up
+const int RESOLUTION_UPGRADE_WINDOWS = 4;           // Consecutive calm windows before stepping up
+const double RESOLUTION_RETRY_DELAY = 10.0;         // Seconds before a step that ran late is tried again
+
+// The internal target is GAME_WIDTH x GAME_HEIGHT times a scale from a ladder of half steps, on which every 16px
+// tile pixel covers a whole number of target pixels. Screens that aren't on the ladder get their own height as
+// an extra top step, where the final upscale is 1:1. The world and UI keep drawing in game units through scaled
+// cameras. A window where a quarter of the frames run late steps down at once, single hitches like map loads
+// don't. GPU cost only shows up as late frames, since raylib gives no GPU timers. Stepping up needs several
+// windows of CPU work well under budget, and a step that ran late waits a while before it is tried again
+struct ResolutionScaler {
+    std::vector<float> steps;
+    int step = 0;
+    RenderTexture2D target = {};
+    int frames = 0, late = 0, calmWindows = 0;
+    double work = 0.0;
+    std::vector<double> lateAt;                     // Per step, GetTime() it last ran late
+
+    ~ResolutionScaler() {
+        if (target.id) unloadRenderTexture(target);
+    }
+
+    // Only whole multiples of RESOLUTION_STEP, so 16px art always lands on whole target pixels. The top step is
+    // the largest that fits the screen both ways, present() letterboxes it 1:1
+    void init(int screenWidth, int screenHeight) {
+        float fit = std::min((float)screenWidth / GAME_WIDTH, (float)screenHeight / GAME_HEIGHT);
+        int top = std::max((int)(1.0f / RESOLUTION_STEP), (int)(fit / RESOLUTION_STEP + 0.001f));
+        steps.clear();
+        for (int n = 1; n <= top; n++)
+            steps.push_back(n * RESOLUTION_STEP);
+        lateAt.assign(steps.size(), -RESOLUTION_RETRY_DELAY);
+        resize(baseStep());
+    }
+
+    int baseStep() const {
+        return (int)(std::find(steps.begin(), steps.end(), 1.0f) - steps.begin());
+    }
+
+    float scale() const {
+        return steps[step];
+    }
+
+    void resize(int newStep) {
+        step = newStep;
+        if (target.id) unloadRenderTexture(target);
+        target = loadRenderTexture((int)roundf(GAME_WIDTH * scale()), (int)roundf(GAME_HEIGHT * scale()), VRAM_TARGETS);
+        frames = late = calmWindows = 0;
+        work = 0.0;
+        TraceLog(LOG_INFO, "RESOLUTION: Internal target %dx%d (%.2fx)", target.texture.width, target.texture.height, scale());
+    }
+
+    // workTime is the frame's CPU time up to presenting, frameTime the whole frame including the pacing wait
+    void update(double workTime, float frameTime, double budget) {
+        if (!DYNAMIC_RESOLUTION) {
+            if (step != baseStep()) resize(baseStep());
+            return;
+        }
+        work += workTime;
+        if (frameTime > budget * RESOLUTION_OVERRUN) late++;
+        if (++frames < RESOLUTION_WINDOW) return;
+
+        double average = work / frames;
+        bool wasLate = late * 4 >= frames;
+        frames = late = 0;
+        work = 0.0;
+        if (wasLate) {
+            calmWindows = 0;
+            lateAt[step] = GetTime();
+            if (step > 0) resize(step - 1);
+        }
+        else if (average < budget * RESOLUTION_HEADROOM && step + 1 < (int)steps.size()) {
+            if (++calmWindows >= RESOLUTION_UPGRADE_WINDOWS && GetTime() - lateAt[step + 1] > RESOLUTION_RETRY_DELAY)
+                resize(step + 1);
+        }
+        else
+            calmWindows = 0;
+    }
+
+    Camera2D worldCamera(const Camera2D& camera) const {
+        Camera2D scaled = camera;
+        scaled.offset = { camera.offset.x * scale(), camera.offset.y * scale() };
+        scaled.zoom = camera.zoom * scale();
+        return scaled;
+    }
+
+    Camera2D uiCamera() const {
+        Camera2D ui = { 0 };
+        ui.zoom = scale();
+        return ui;
+    }
+
+    // Point filtered and centered at the top step's size, so at the top step this is 1:1 and the rest of the
+    // screen is black bars. Screens smaller than the game shrink to fit
+    void present() {
+        float sw = (float)GetScreenWidth(), sh = (float)GetScreenHeight();
+        float s = std::min(steps.back(), std::min(sw / GAME_WIDTH, sh / GAME_HEIGHT));
+        float w = GAME_WIDTH * s, h = GAME_HEIGHT * s;
+        ClearBackground(BLACK);
+        DrawTexturePro(target.texture, Rectangle{ 0, 0, (float)target.texture.width, -(float)target.texture.height },
+            Rectangle{ floorf((sw - w) / 2), floorf((sh - h) / 2), w, h }, Vector2{0,0}, 0, WHITE);
+    }
+};
+
+void initialize() {
+    //Game Window
+    InitWindow(0, 0, "Empyral Imperium");
+    ToggleBorderlessWindowed();
+    ClearWindowState(FLAG_WINDOW_TOPMOST);
+    pacer.begin(settings.pacing, settings.fps);
+    HideCursor();
+}
+
+// Event scripting: every action is a coroutine. A suspended action costs nothing until whatever it
+// waits on (a timer, a finished dialogue, a finished move) wakes it up, so long cutscenes don't add per-frame work
+struct Script {
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+        int* pending = nullptr;             // Only in whenAll children, parent resumes when it reaches 0
+
+        Script get_return_object() { return Script(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                promise_type& p = h.promise();
+                if (p.pending && --(*p.pending) > 0) return std::noop_coroutine();
+                if (p.continuation) return p.continuation;
+                return std::noop_coroutine();
+            }
+            void await_resume() noexcept { }
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    Script() { }
+    explicit Script(std::coroutine_handle<promise_type> h) : handle(h) { }
+    Script(Script&& other) noexcept : handle(std::exchange(other.handle, nullptr)) { }
+    Script& operator=(Script&& other) noexcept {
+        if (this != &other) {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    ~Script() { reset(); }
+
+    void reset() {
+        if (handle) handle.destroy();
+        handle = nullptr;
+    }
+
+    bool done() const { return !handle || handle.done(); }
+
+    // co_await on a script runs it as a child and resumes the parent when it finishes
+    bool await_ready() const noexcept { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> parent) noexcept {
+        handle.promise().continuation = parent;
+        return handle;
+    }
+    void await_resume() noexcept { }
+};
+
+// Runs every script at once, the parent is resumed by the last one to finish
+struct WhenAll {
+    std::vector<Script> scripts;
+    int pending = 0;
+
+    bool await_ready() const noexcept { return scripts.empty(); }
+    bool await_suspend(std::coroutine_handle<> parent) {
+        pending = (int)scripts.size() + 1;          // +1 so no child can resume the parent before all of them started
+        for (Script& s : scripts) {
+            s.handle.promise().continuation = parent;
+            s.handle.promise().pending = &pending;
+        }
+        for (Script& s : scripts)
+            s.handle.resume();
+        return --pending > 0;
+    }
+    void await_resume() noexcept { }
+};
+
+WhenAll whenAll(std::vector<Script> scripts) {
+    return WhenAll{std::move(scripts)};
+}
+
+// Awaitables that need to be stepped every frame until they finish (moves)
+struct ScriptTicker {
+    std::coroutine_handle<> waiter;
+    virtual bool tick(float dt) = 0;        // True when finished
+    virtual ~ScriptTicker() { }
+};
+
+struct ScriptScheduler {
+    Script main;
+    double time = 0.0;
+
+    std::vector<ScriptTicker*> tickers;
+    std::vector<std::pair<double, std::coroutine_handle<>>> timers;     // Min-heap on wake time
+    std::vector<std::coroutine_handle<>> ready, resuming;
+    std::coroutine_handle<> dialogueWaiter;
+
+    void start(Script script) {
+        clear();
+        main = std::move(script);
+        main.handle.resume();
+    }
+
+    bool running() {
+        return !main.done();
+    }
+
+    void sleep(double seconds, std::coroutine_handle<> h) {
+        timers.push_back({time + seconds, h});
+        std::push_heap(timers.begin(), timers.end(), std::greater<>());
+    }
+
+    void tick(float dt) {
+        time += dt;
+
+        while (!timers.empty() && timers.front().first <= time) {
+            std::pop_heap(timers.begin(), timers.end(), std::greater<>());
+            ready.push_back(timers.back().second);
+            timers.pop_back();
+        }
+
+        // Compacted in place to keep the order in which actions started (camera follow depends on it)
+        size_t alive = 0;
+        for (size_t i = 0; i < tickers.size(); i++) {
+            if (tickers[i]->tick(dt))
+                ready.push_back(tickers[i]->waiter);
+            else
+                tickers[alive++] = tickers[i];
+        }
+        tickers.resize(alive);
+
+        resuming.swap(ready);
+        for (std::coroutine_handle<> h : resuming)
+            h.resume();
+        resuming.clear();
+    }
+
+    void finishDialogue() {
+        if (!dialogueWaiter) return;
+        ready.push_back(dialogueWaiter);
+        dialogueWaiter = nullptr;
+    }
+
+    void clear() {
+        tickers.clear();
+        timers.clear();
+        ready.clear();
+        dialogueWaiter = nullptr;
+        main.reset();
+        time = 0.0;
+    }
+};
+
+ScriptScheduler scheduler;
+
+void startDialogue(Player& player, const Dialogue* dialogue, NPC* npc) {
+    TelemetryScope scope(SCOPE_DIALOGUE, dialogue ? dialogue->name : NO_NAME);
+    gameState = STATE_DIALOGUE;
+    player.currentDialogue = dialogue;
+    player.currentDialogueNPC = npc;
+
+    player.play(CLIP_IDLE);
+
+    player.dialogueIndex = 0;
+    player.visibleChars = 0;
+    player.textTimer = 0.0f;
+    player.lineFinished = false;
+}
+
+struct WaitSeconds {
+    float seconds;
+
+    bool await_ready() const noexcept { return seconds <= 0.0f; }
+    void await_suspend(std::coroutine_handle<> h) { scheduler.sleep(seconds, h); }
+    void await_resume() noexcept { }
+};
+
+struct PlayDialogue {
+    Player& player;
+    const Dialogue* dialogue;
+
+    bool await_ready() const noexcept { return dialogue == nullptr; }
+    void await_suspend(std::coroutine_handle<> h) {
+        startDialogue(player, dialogue, nullptr);
+        scheduler.dialogueWaiter = h;
+    }
+    void await_resume() noexcept { }
+};
+
+// Shared by every move awaitable: target is fixed when the move starts, not when it's parsed
+float moveTarget(float x, float y, int direction, int tiles) {
+    switch (direction) {
+        case RIGHT: return x + tiles * tileSize;
+        case LEFT:  return x - tiles * tileSize;
+        case DOWN:  return y + tiles * tileSize;
+        case UP:    return y - tiles * tileSize;
+    }
+    return 0.0f;
+}
+
+// Displacement of a straight move step
+Vector2 moveStep(int direction, float step) {
+    switch (direction) {
+        case RIGHT: return { step, 0.0f };
+        case LEFT:  return { -step, 0.0f };
+        case DOWN:  return { 0.0f, step };
+        case UP:    return { 0.0f, -step };
+    }
+    return { 0.0f, 0.0f };
+}
+
+const float SCRIPT_BLOCKED_TIMEOUT = 1.0f;  // Seconds a scripted move waits on something in its way before giving up
+
+struct MoveCamera : ScriptTicker {
+    Camera2D& camera;
+    Player& player;
+    int direction, tiles;
+    float speed, target = 0.0f;
+    float position = 0.0f;          // Unrounded, a sub-pixel step per frame still adds up at high frame rates
+
+    MoveCamera(Camera2D& camera_, Player& player_, int direction_, int tiles_, float speed_)
+        : camera(camera_), player(player_), direction(direction_), tiles(tiles_), speed(speed_) { }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        waiter = h;
+        player.play(CLIP_IDLE);
+        target = moveTarget(camera.target.x, camera.target.y, direction, tiles);
+        position = (direction == RIGHT || direction == LEFT) ? camera.target.x : camera.target.y;
+        scheduler.tickers.push_back(this);
+    }
+    void await_resume() noexcept { }
+
+    // The camera only ever sees whole pixels, the ticker keeps the exact position
+    bool tick(float dt) override {
+        switch (direction) {
+            case RIGHT: position = std::min(position + speed * dt, target); break;
+            case LEFT:  position = std::max(position - speed * dt, target); break;
+            case DOWN:  position = std::min(position + speed * dt, target); break;
+            case UP:    position = std::max(position - speed * dt, target); break;
+            default:    return true;
+        }
+        if (direction == RIGHT || direction == LEFT)
+            camera.target.x = floor(position);
+        else
+            camera.target.y = floor(position);
+        return position == target;
+    }
+};
+
+struct MoveNpc : ScriptTicker {
+    Map& map;
+    NPC& npc;
+    const Player& player;
+    Camera2D& camera;
+    int direction, tiles;
+    bool follow;
+    float target = 0.0f;
+    float blocked = 0.0f;
+
+    MoveNpc(Map& map_, NPC& npc_, const Player& player_, Camera2D& camera_, int direction_, int tiles_, bool follow_)
+        : map(map_), npc(npc_), player(player_), camera(camera_), direction(direction_), tiles(tiles_), follow(follow_) { }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        waiter = h;
+        npc.walking = false;
+        npc.direction = direction;
+        target = moveTarget(npc.x, npc.y, direction, tiles);
+        scheduler.tickers.push_back(this);
+    }
+    void await_resume() noexcept { }
+
+    bool tick(float dt) override {
+        bool horizontal = (direction == RIGHT || direction == LEFT);
+        float distance = fabs(target - (horizontal ? npc.x : npc.y));
+
+        if (distance <= 1.0f) {
+            npc.frame = 0;
+            return true;
+        }
+
+        float step = std::min(npc.speed * dt, distance);        // Never overshoot the target at low frame rates
+        Vector2 moved = map.move(npc.body, moveStep(direction, step), &npc, &player.body);
+        npc.x += moved.x;
+        npc.y += moved.y;
+        if (follow)
+            camera.target = { floor(npc.x + tileSize/2.0f), floor(npc.y + tileSize/2.0f) };
+
+        npc.updateBody();
+        if (fabs(moved.x) + fabs(moved.y) < step - MOVE_SKIN) {
+            blocked += dt;
+            if (blocked >= SCRIPT_BLOCKED_TIMEOUT) {
+                TraceLog(LOG_WARNING, "SCRIPT: %s blocked, move cut short", nameOf(npc.name).c_str());
+                npc.frame = 0;
+                return true;
+            }
+        }
+        else blocked = 0.0f;
+        if (npc.visible) npc.updateFrame(dt);
+        return false;
+    }
+};
+
+struct MovePlayer : ScriptTicker {
+    Map& map;
+    Player& player;
+    Camera2D& camera;
+    int direction, tiles;
+    bool follow;
+    float target = 0.0f;
+    float blocked = 0.0f;
+
+    MovePlayer(Map& map_, Player& player_, Camera2D& camera_, int direction_, int tiles_, bool follow_)
+        : map(map_), player(player_), camera(camera_), direction(direction_), tiles(tiles_), follow(follow_) { }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        waiter = h;
+        player.direction = direction;
+        target = moveTarget(player.x, player.y, direction, tiles);
+        player.speed = 150.0f;
+        player.play(CLIP_WALK);
+        scheduler.tickers.push_back(this);
+    }
+    void await_resume() noexcept { }
+
+    bool tick(float dt) override {
+        bool horizontal = (direction == RIGHT || direction == LEFT);
+        float distance = fabs(target - (horizontal ? player.x : player.y));
+
+        if (distance <= 1.0f) return true;
+
+        float step = std::min(player.speed * dt, distance);        // Never overshoot the target at low frame rates
+        Vector2 moved = map.move(player.body, moveStep(direction, step));
+        player.x += moved.x;
+        player.y += moved.y;
+        if (follow)
+            camera.target = { floor(player.x + tileSize/2.0f), floor(player.y + tileSize/2.0f) };
+
+        player.updatePlayerBody();
+        if (fabs(moved.x) + fabs(moved.y) < step - MOVE_SKIN) {
+            blocked += dt;
+            if (blocked >= SCRIPT_BLOCKED_TIMEOUT) {
+                TraceLog(LOG_WARNING, "SCRIPT: Player blocked, move cut short");
+                return true;
+            }
+        }
+        else blocked = 0.0f;
+        player.updatePlayerFrame(dt);
+        return false;
+    }
+};
+
+// Walks an NPC to a tile, waiting for the path worker first. Animation direction follows the dominant axis
+struct PathNpc : ScriptTicker {
+    Map& map;
+    NPC& npc;
+    const Player& player;
+    Camera2D& camera;
+    GridPoint goal;
+    bool follow;
+    uint32_t ticket = 0;
+    bool waiting = true;
+    PathResult path;
+    size_t next = 0;                    // Starts by centering the NPC on its own tile
+    float blocked = 0.0f;
+
+    PathNpc(Map& map_, NPC& npc_, const Player& player_, Camera2D& camera_, GridPoint goal_, bool follow_)
+        : map(map_), npc(npc_), player(player_), camera(camera_), goal(goal_), follow(follow_) { }
+
+    ~PathNpc() {
+        if (waiting && ticket) map.pathing.cancel(ticket);
+    }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        waiter = h;
+        npc.walking = false;
+        ticket = map.pathing.request(npcTile(npc), goal);
+        scheduler.tickers.push_back(this);
+    }
+    void await_resume() noexcept { }
+
+    bool tick(float dt) override {
+        if (waiting) {
+            if (!map.pathing.poll(ticket, path)) return false;
+            waiting = false;
+            if (!path.found) {
+                TraceLog(LOG_WARNING, "PATH: %s can't reach tile %d,%d", nameOf(npc.name).c_str(), goal.x, goal.y);
+                return true;
+            }
+        }
+
+        // Walkable cells are ones a body clears (buildNavigation), so anything stopping the NPC is another character
+        float step = npc.speed * dt;
+        bool stuck = false;
+        while (step > 0.0f && next < path.tiles.size()) {
+            Vector2 target = npcPositionAt(path.tiles[next]);
+            float dx = target.x - npc.x, dy = target.y - npc.y;
+            float distance = sqrtf(dx*dx + dy*dy);
+            if (distance > 0.0f)
+                npc.direction = (fabs(dx) > fabs(dy)) ? (dx > 0 ? RIGHT : LEFT) : (dy > 0 ? DOWN : UP);
+            float length = std::min(distance, step);
+            Vector2 want = { 0.0f, 0.0f };
+            if (distance > 0.0f) want = { dx / distance * length, dy / distance * length };
+            Vector2 moved = map.move(npc.body, want, &npc, &player.body);
+            npc.x += moved.x;
+            npc.y += moved.y;
+            npc.updateBody();
+            if (fabs(moved.x - want.x) + fabs(moved.y - want.y) > MOVE_SKIN) {
+                stuck = true;
+                break;
+            }
+            if (distance <= step) {
+                npc.x = target.x;
+                npc.y = target.y;
+                npc.updateBody();
+                next++;
+            }
+            step -= length;
+        }
+        if (follow)
+            camera.target = { floor(npc.x + tileSize/2.0f), floor(npc.y + tileSize/2.0f) };
+
+        if (next >= path.tiles.size()) {
+            npc.frame = 0;
+            return true;
+        }
+        if (stuck) {
+            blocked += dt;
+            if (blocked >= SCRIPT_BLOCKED_TIMEOUT) {
+                TraceLog(LOG_WARNING, "PATH: %s blocked, stopping short of tile %d,%d", nameOf(npc.name).c_str(), goal.x, goal.y);
+                npc.frame = 0;
+                return true;
+            }
+        }
+        else blocked = 0.0f;
+        if (npc.visible) npc.updateFrame(dt);
+        return false;
+    }
+};
+
+const float NPC_NEAR_MARGIN = 4.0f * tileSize;         // Around the view, NPCs there update every frame
+const float NPC_FREEZE_RADIUS = 48.0f * tileSize;      // From the camera target, NPCs beyond it don't update at all
+const float NPC_FAR_INTERVAL = 0.25f;                  // Seconds between updates of NPCs out of view
+const float NPC_MAX_CATCHUP = 1.0f;                    // Owed time is capped, a long absence isn't simulated
+const double NPC_FAR_BUDGET = 0.0005;                  // Seconds per frame shared by every NPC out of view
+
+// Ambient NPC updates with a level of detail. NPCs near the view update every frame, the ones further away
+// owe their time and get it back in one bigger step when their turn comes around, within a per-frame budget.
+// Past NPC_FREEZE_RADIUS nothing runs, so the cost per frame follows what's on screen, not the NPC count
+struct NpcScheduler {
+    size_t cursor = 0;                          // Round robin start among far NPCs
+    int nearCount = 0, farCount = 0, frozenCount = 0, caughtUp = 0;     // Last frame, for the debug overlay
+
+    // Every frame, scripted moves and drawing read visible too
+    void classify(Map& map, const Camera2D& camera) {
+        Rectangle view = cameraView(camera);
+        Rectangle near = { view.x - NPC_NEAR_MARGIN, view.y - NPC_NEAR_MARGIN,
+                           view.width + 2 * NPC_NEAR_MARGIN, view.height + 2 * NPC_NEAR_MARGIN };
+
+        for (NPC& npc : map.npcs) {
+            Rectangle sprite = { npc.x, npc.y - (npc.spriteH - tileSize), npc.spriteW, npc.spriteH };
+            npc.visible = CheckCollisionRecs(sprite, view);
+            float dx = npc.body.x - camera.target.x, dy = npc.body.y - camera.target.y;
+            if (CheckCollisionRecs(npc.body, near))
+                npc.lod = LOD_NEAR;
+            else if (dx*dx + dy*dy < NPC_FREEZE_RADIUS * NPC_FREEZE_RADIUS)
+                npc.lod = LOD_FAR;
+            else
+                npc.lod = LOD_FROZEN;
+        }
+    }
+
+    void update(Map& map, const Player& player, float dt) {
+        nearCount = farCount = frozenCount = caughtUp = 0;
+        for (NPC& npc : map.npcs) {
+            switch (npc.lod) {
+                case LOD_NEAR:
+                    step(npc, map, player, npc.owedTime + dt);
+                    npc.owedTime = 0.0f;
+                    nearCount++;
+                    break;
+                case LOD_FAR:
+                    npc.owedTime = std::min(npc.owedTime + dt, NPC_MAX_CATCHUP);
+                    farCount++;
+                    break;
+                case LOD_FROZEN:
+                    npc.owedTime = 0.0f;
+                    frozenCount++;
+                    break;
+            }
+        }
+
+        size_t count = map.npcs.size();
+        if (!farCount) return;
+        double start = GetTime();
+        size_t scanned = 0;
+        for (; scanned < count && GetTime() - start < NPC_FAR_BUDGET; scanned++) {
+            NPC& npc = map.npcs[(cursor + scanned) % count];
+            if (npc.lod != LOD_FAR || npc.owedTime < NPC_FAR_INTERVAL) continue;
+            step(npc, map, player, npc.owedTime);
+            npc.owedTime = 0.0f;
+            caughtUp++;
+        }
+        cursor = (cursor + scanned) % count;
+    }
+
+    // Idle NPCs look around, wandering ones walk a few tiles in a straight line without leaving their radius
+    void step(NPC& npc, Map& map, const Player& player, float dt) {
+        if (npc.behaviour == BEHAVIOUR_NONE) return;
+
+        if (!npc.walking) {
+            npc.behaviourTimer -= dt;
+            if (npc.behaviourTimer > 0.0f) return;
+            npc.behaviourTimer = GetRandomValue(200, 500) / 100.0f;
+
+            static const int directions[4] = { DOWN, UP, RIGHT, LEFT };
+            int direction = directions[GetRandomValue(0, 3)];
+            npc.direction = direction;
+            if (npc.behaviour != BEHAVIOUR_WANDER) return;
+
+            GridPoint tile = npcTile(npc);
+            int dx = (direction == RIGHT) - (direction == LEFT), dy = (direction == DOWN) - (direction == UP);
+            int tiles = 0, wanted = GetRandomValue(1, 3);
+            while (tiles < wanted) {
+                int tx = tile.x + dx * (tiles + 1), ty = tile.y + dy * (tiles + 1);
+                if (abs(tx - npc.homeX) > npc.wanderRadius || abs(ty - npc.homeY) > npc.wanderRadius) break;
+                if (map.collisionValue(tx, ty) != -1) break;
+                tiles++;
             }
-            events.push_back(ev);
+            if (!tiles) return;
+            npc.walking = true;
+            npc.walkDirection = direction;
+            npc.walkTarget = moveTarget(npc.x, npc.y, direction, tiles);
+        }
+
+        bool horizontal = (npc.walkDirection == RIGHT || npc.walkDirection == LEFT);
+        float distance = fabs(npc.walkTarget - (horizontal ? npc.x : npc.y));
+        float stepLength = std::min(npc.speed * dt, distance);
+        Vector2 moved = map.move(npc.body, moveStep(npc.walkDirection, stepLength), &npc, &player.body);
+        npc.x += moved.x;
+        npc.y += moved.y;
+        npc.updateBody();
+        if (fabs(moved.x) + fabs(moved.y) < stepLength - MOVE_SKIN)        // Gives way, tries somewhere else next time
+            distance = 0.0f;
+        else
+            distance -= stepLength;
+
+        if (distance <= 0.0f) {
+            npc.walking = false;
+            npc.frame = 0;
+        }
+        else if (npc.visible)
+            npc.updateFrame(dt);
+    }
+};
+
+NpcScheduler npcScheduler;
+
+Script runAction(const EventAction& action, Player& player, Map& map, Camera2D& camera) {
+    switch (action.type) {
+        case ACTION_DIALOGUE: {
+            co_await PlayDialogue{player, map.findDialogue(action.dialogue)};
+            break;
+        }
+        case ACTION_MOVE_CAMERA:
+            co_await MoveCamera(camera, player, action.direction, action.tiles, action.speed);
+            break;
+        case ACTION_MOVE_NPC:
+            if (action.npc)
+                co_await MoveNpc(map, *action.npc, player, camera, action.direction, action.tiles, action.follow);
+            break;
+        case ACTION_PATH_NPC:
+            if (action.npc)
+                co_await PathNpc(map, *action.npc, player, camera, { action.targetX, action.targetY }, action.follow);
+            break;
+        case ACTION_MOVE_PLAYER:
+            co_await MovePlayer(map, player, camera, action.direction, action.tiles, action.follow);
+            break;
+        case ACTION_WAIT:
+            co_await WaitSeconds{action.seconds};
+            break;
+        case ACTION_GROUP: {
+            std::vector<Script> group;
+            for (const EventAction& sub : action.subactions)
+                group.push_back(runAction(sub, player, map, camera));
+            co_await whenAll(std::move(group));
+            break;
         }
     }
+}
+
+Script runEvent(Event& ev, Player& player, Map& map, Camera2D& camera) {
+    for (const EventAction& action : ev.actions)
+        co_await runAction(action, player, map, camera);
+}
+
+const float REWIND_SECONDS = 10.0f;
+const size_t REWIND_BUDGET = 1024 * 1024;
+const int REWIND_KEYFRAME_INTERVAL = 60;
+
+// Ring of per-tick world snapshots for rewinding and replaying cutscenes. Every entry is XORed against the
+// last keyframe (keyframes against zeros) and stored as runs of unchanged bytes plus the changed ones,
+// so a still world costs a few bytes per tick. Bytes and entries live in fixed rings, oldest dropped first
+struct RewindBuffer {
+    struct Entry {
+        uint32_t offset, size;      // In bytes
+        uint64_t keyframe;          // Sequence number of the keyframe it's encoded against (itself for keyframes)
+    };
+
+    std::vector<uint8_t> bytes;
+    std::vector<Entry> entries;     // Indexed by sequence number % size
+    uint64_t first = 0, end = 0;    // Stored sequence numbers are [first, end)
+    size_t head = 0;                // Next write offset in bytes
+    size_t snapshotSize = 0;
+    NameId map = NO_NAME;           // Snapshots only make sense inside one map
+
+    bool hasKeyframe = false;
+    uint64_t lastKeyframe = 0;
+    std::vector<uint8_t> keyframe;  // Decoded lastKeyframe, what new deltas are encoded against
+    std::vector<uint8_t> encoded;
+    std::vector<uint8_t> base;      // Decoded keyframe of the last stepped entry
+    uint64_t baseSeq = UINT64_MAX;
+
+    // Snapshots are taken and replayed at the tick rate, whatever the frame rate
+    float tickInterval = 1.0f / DEFAULT_TICK_RATE;
+    float clock = 0.0f;
+
+    // Replay
+    uint64_t cursor = 0;
+    GameState resumeState = STATE_NORMAL;
+
+    void configure(float seconds, int tickRate, size_t budget) {
+        MemoryScope scope(MEM_REWIND);
+        tickInterval = 1.0f / tickRate;
+        // One keyframe interval extra, evicting a keyframe takes its whole group with it
+        entries.assign((size_t)(seconds * tickRate) + REWIND_KEYFRAME_INTERVAL, {});
+        bytes.assign(budget, 0);
+        clear();
+    }
 
-    int collisionValue(int tx, int ty) {
-        if (tx < 0 || ty < 0 || ty >= height || tx >= width)
-            return true; // Outside the map
-        return collisions[ty][tx];
+    void clear() {
+        first = end = 0;
+        head = 0;
+        hasKeyframe = false;
+        baseSeq = UINT64_MAX;
     }
 
-    Rectangle getTileCollider(int tx, int ty, int col) {
-        //0 DOWN, 1 UP, 2 RIGHT, 3 LEFT
+    // At most one tick per frame, a long frame doesn't queue up copies of the same state
+    bool tickDue(float dt) {
+        clock += dt;
+        if (clock < tickInterval) return false;
+        clock = std::min(clock - tickInterval, tickInterval);
+        return true;
+    }
 
-        if (col < 32*1) {
-            return Rectangle{
-                tx * tileSize + 0.0f,
-                ty * tileSize + col + 0.0f,
-                tileSize,
-                tileSize
-            };
-        }
-        else if (col < 32*2) {
-            col = col % 32;
-            return Rectangle{
-                tx * tileSize + 0.0f,
-                ty * tileSize - col + 0.0f,
-                tileSize,
-                tileSize
-            };
-        }
-        else if (col < 32*3) {
-            col = col % 32;
-            return Rectangle{
-                tx * tileSize + col + 0.0f,
-                ty * tileSize + 0.0f,
-                tileSize,
-                tileSize
-            };
-        }
-        else if (col < 32*4) {
-            col = col % 32;
-            return Rectangle{
-                tx * tileSize - col + 0.0f,
-                ty * tileSize + 0.0f,
-                tileSize,
-                tileSize
-            };
+    Entry& entry(uint64_t seq) { return entries[seq % entries.size()]; }
+    size_t count() const { return end - first; }
+
+    void evictOldest() {
+        first++;
+        while (first < end && entry(first).keyframe < first)       // Its keyframe is gone, it can't be decoded anymore
+            first++;
+    }
+
+    // base == nullptr encodes against zeros
+    void encode(const uint8_t* data, const uint8_t* against) {
+        encoded.clear();
+        size_t i = 0;
+        while (i < snapshotSize) {
+            uint8_t same = 0, changed = 0;
+            while (i < snapshotSize && same < 255 && data[i] == (against ? against[i] : 0)) { same++; i++; }
+            while (i + changed < snapshotSize && changed < 255 && data[i + changed] != (against ? against[i + changed] : 0)) changed++;
+            encoded.push_back(same);
+            encoded.push_back(changed);
+            for (uint8_t k = 0; k < changed; k++, i++)
+                encoded.push_back(data[i] ^ (against ? against[i] : 0));
         }
-        else return Rectangle {};       // Error, should never happen
     }
 
-    bool checkCollision(Rectangle& playerBody) {
-        return (checkMapCollision(playerBody) || checkNpcCollision(playerBody));
+    // XORs an entry into out, which already holds what it was encoded against
+    void apply(const Entry& e, uint8_t* out) const {
+        const uint8_t* p = &bytes[e.offset];
+        const uint8_t* stop = p + e.size;
+        size_t i = 0;
+        while (p < stop) {
+            i += *p++;
+            uint8_t changed = *p++;
+            for (uint8_t k = 0; k < changed; k++)
+                out[i++] ^= *p++;
+        }
     }
 
-    bool checkMapCollision(Rectangle& playerBody) {
-        int left   = (int)floor(playerBody.x / tileSize - 1.0f);
-        int right  = (int)floor((playerBody.x + playerBody.width) / tileSize + 1.0f);
-        int top    = (int)floor(playerBody.y / tileSize - 1.0f);
-        int bottom = (int)floor((playerBody.y + playerBody.height) / tileSize + 1.0f);
+    void push(const std::vector<uint8_t>& snapshot, NameId mapName) {
+        if (entries.empty()) return;
+        if (snapshot.size() != snapshotSize || mapName != map) {
+            clear();
+            snapshotSize = snapshot.size();
+            map = mapName;
+            keyframe.assign(snapshotSize, 0);
+            base.assign(snapshotSize, 0);
+        }
 
-        for (int y = top; y <= bottom; y++) {
-            for (int x = left; x <= right; x++) {
-                
-                int col = collisionValue(x, y);
-                if (col == -1)
-                    continue;
+        bool isKeyframe = !hasKeyframe || lastKeyframe < first || end - lastKeyframe >= REWIND_KEYFRAME_INTERVAL;
+        size_t n;
+        for (;;) {
+            encode(snapshot.data(), isKeyframe ? nullptr : keyframe.data());
+            n = encoded.size();
+            if (n > bytes.size()) return;               // Budget can't even hold one tick
+
+            if (count() == entries.size()) evictOldest();
+            if (head + n > bytes.size()) {
+                // Tail too short, skip it. Whatever is still stored past head is older than everything before it
+                while (first < end && entry(first).offset >= head) evictOldest();
+                head = 0;
+            }
+            while (first < end && entry(first).offset >= head && entry(first).offset < head + n) evictOldest();
 
-                Rectangle tileCol = getTileCollider(x, y, col);
-                if (DEBUG_MODE) debugColliders.push_back(tileCol);      //DEBUG
+            if (isKeyframe || lastKeyframe >= first) break;
+            isKeyframe = true;                          // Making room dropped the keyframe this delta was against
+        }
 
-                if (CheckCollisionRecs(playerBody, tileCol))
-                    return true;
-            }
+        memcpy(&bytes[head], encoded.data(), n);
+        entry(end) = { (uint32_t)head, (uint32_t)n, isKeyframe ? end : lastKeyframe };
+        if (isKeyframe) {
+            memcpy(keyframe.data(), snapshot.data(), snapshotSize);
+            lastKeyframe = end;
+            hasKeyframe = true;
         }
-        return false;
+        head += n;
+        end++;
     }
 
-    bool checkNpcCollision(Rectangle& playerBody) {
-        for (NPC npc : npcs)
-            if (CheckCollisionRecs(playerBody, npc.body))
-                return true;
-        return false;
+    // O(snapshot size) whatever the distance to the keyframe, stepping within a keyframe reuses its decode
+    void decode(uint64_t seq, std::vector<uint8_t>& out) {
+        const Entry& e = entry(seq);
+        out.resize(snapshotSize);
+        if (e.keyframe == seq) {
+            std::fill(out.begin(), out.end(), 0);
+            apply(e, out.data());
+            return;
+        }
+        if (baseSeq != e.keyframe) {
+            std::fill(base.begin(), base.end(), 0);
+            apply(entry(e.keyframe), base.data());
+            baseSeq = e.keyframe;
+        }
+        memcpy(out.data(), base.data(), snapshotSize);
+        apply(e, out.data());
     }
 
-    Tileset* findTileset(int gid) {
-        for (int i = tilesets.size() - 1; i >= 0; --i) {
-            if (gid >= tilesets[i].firstGid)
-                return &tilesets[i];
-        }
-        return nullptr;
+    // Drops everything after seq, recording continues from there
+    void truncate(uint64_t seq) {
+        end = seq + 1;
+        const Entry& e = entry(seq);
+        head = e.offset + e.size;
+        lastKeyframe = e.keyframe;
+        std::fill(keyframe.begin(), keyframe.end(), 0);
+        apply(entry(lastKeyframe), keyframe.data());
+        hasKeyframe = true;
+        baseSeq = UINT64_MAX;
     }
+};
 
-    void drawMap(bool altitude) {               // True for normal layers, false for topmost layers
-        for (TileLayer& layer : layers) {
-            if (altitude && layer.name == LAYER_ALWAYSABOVE) continue;
-            if (!altitude && layer.name != LAYER_ALWAYSABOVE) continue;
+RewindBuffer history;
 
-            for (int y = 0; y < layer.height; y++) {
-                for (int x = 0; x < layer.width; x++) {
-                    int gid = layer.data[y * layer.width + x];
+// Snapshot layout: TickHeader, one TickNpc per Map::npcs, one triggered byte per Map::events
+struct TickHeader {
+    float playerX, playerY;
+    int32_t playerDirection, playerClip, playerFrame;
+    float cameraX, cameraY;
+    int32_t state;
+    int32_t ongoingEvent;           // Map::events index, -1 for none
+};
 
-                    if (gid <= 0) continue;
+struct TickNpc {
+    float x, y;
+    int32_t direction, clip, frame;
+};
 
-                    Tileset* ts = findTileset(gid);
-                    if (!ts) continue;
+size_t tickSize(const Map& map) {
+    return sizeof(TickHeader) + map.npcs.size() * sizeof(TickNpc) + map.events.size();
+}
 
-                    int localId = gid - ts->firstGid;
+void captureTick(std::vector<uint8_t>& out, const Player& player, const Map& map, const Camera2D& camera) {
+    out.resize(tickSize(map));
+    TickHeader h = {
+        player.x, player.y, player.direction, player.clip, player.frame,
+        camera.target.x, camera.target.y,
+        gameState,
+        player.ongoingEvent ? (int32_t)(player.ongoingEvent - map.events.data()) : -1
+    };
+    uint8_t* p = out.data();
+    memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    for (const NPC& npc : map.npcs) {
+        TickNpc t = { npc.x, npc.y, npc.direction, npc.clip, npc.frame };
+        memcpy(p, &t, sizeof(t));
+        p += sizeof(t);
+    }
+    for (const Event& ev : map.events)
+        *p++ = ev.triggered;
+}
 
-                    auto it = ts->animations.find(localId);
-                    if (it != ts->animations.end()) {
-                        std::vector<TileAnimationFrame> anim = it->second;
+TickHeader tickHeader(const std::vector<uint8_t>& in) {
+    TickHeader h;
+    memcpy(&h, in.data(), sizeof(h));
+    return h;
+}
 
-                        int totalTime = 0;
-                        for (TileAnimationFrame f : anim) totalTime += f.duration;
+void applyTick(const std::vector<uint8_t>& in, Player& player, Map& map, Camera2D& camera) {
+    if (in.size() != tickSize(map)) return;         // Map changed under the buffer (hot reload)
+    TickHeader h = tickHeader(in);
+    player.x = h.playerX;
+    player.y = h.playerY;
+    player.direction = h.playerDirection;
+    player.clip = h.playerClip;
+    player.frame = h.playerFrame;
+    player.updatePlayerBody();
+    camera.target = { h.cameraX, h.cameraY };
+
+    const uint8_t* p = in.data() + sizeof(h);
+    for (NPC& npc : map.npcs) {
+        TickNpc t;
+        memcpy(&t, p, sizeof(t));
+        p += sizeof(t);
+        npc.x = t.x;
+        npc.y = t.y;
+        npc.direction = t.direction;
+        npc.clip = t.clip;
+        npc.frame = t.frame;
+        npc.walking = false;                // A wander target from another moment could cross walls
+        npc.updateBody();
+    }
+    for (Event& ev : map.events) {
+        ev.triggered = *p++;
+        world.setFlag(ev.flag, ev.triggered);
+    }
+}
 
-                        int t = (int)(GetTime() * 1000) % totalTime;
+std::vector<uint8_t> rewindTick;       // Reused by capture and replay, no allocations once warm
 
-                        int acc = 0;
-                        for (TileAnimationFrame f : anim) {
-                            acc += f.duration;
-                            if (t < acc) {
-                                localId = f.tileId;
-                                break;
-                            }
-                        }
-                    }
+// F3 enters replay, LEFT/RIGHT step one tick per tick interval, F3 again leaves. Play resumes from the shown tick
+// when nothing scripted was running there, otherwise the live tick is put back (coroutines can't be rewound)
+void toggleRewind(Player& player, Map& map, Camera2D& camera) {
+    if (gameState != STATE_REWIND) {
+        if (gameState == STATE_TRANSITION || history.count() == 0) return;
+        history.resumeState = gameState;
+        history.cursor = history.end - 1;
+        gameState = STATE_REWIND;
+        return;
+    }
 
-                    Rectangle src = {
-                        (float)((localId % ts->columns) * ts->tileWidth),
-                        (float)((localId / ts->columns) * ts->tileHeight),
-                        (float)ts->tileWidth,
-                        (float)ts->tileHeight
-                    };
-
-                    Rectangle dst = {
-                        (float)(x * tileSize),
-                        (float)(y * tileSize),
-                        (float)tileSize,
-                        (float)tileSize
-                    };
-
-                    DrawTexturePro(ts->texture, src, dst, {0,0}, 0, WHITE);
-                }
-            }
-        }
+    uint64_t live = history.end - 1;
+    history.decode(history.cursor, rewindTick);
+    TickHeader h = tickHeader(rewindTick);
+    if (history.cursor != live && h.state == STATE_NORMAL && h.ongoingEvent < 0) {
+        scheduler.clear();
+        player.ongoingEvent = nullptr;
+        player.currentDialogue = nullptr;
+        player.currentDialogueNPC = nullptr;
+        history.truncate(history.cursor);
+        gameState = STATE_NORMAL;
+        return;
     }
-};
+    history.decode(live, rewindTick);
+    applyTick(rewindTick, player, map, camera);
+    gameState = history.resumeState;
+}
 
-Camera2D setupCamera(Player &player) {
-    Camera2D camera = {0};
-    camera.target = { player.x + tileSize/2.0f, player.y + tileSize/2.0f };
-    camera.offset = { GAME_WIDTH/2.0f, GAME_HEIGHT/2.0f };
-    camera.rotation = 0.0f;
-    camera.zoom = 1.0f;
-    return camera;
+void rewindInput(Player& player, Map& map, Camera2D& camera) {
+    if (!history.tickDue(GetFrameTime())) return;
+    uint64_t target = history.cursor;
+    if (IsKeyDown(KEY_LEFT) && target > history.first) target--;
+    if (IsKeyDown(KEY_RIGHT) && target + 1 < history.end) target++;
+    if (target == history.cursor) return;
+    history.cursor = target;
+    history.decode(target, rewindTick);
+    applyTick(rewindTick, player, map, camera);
 }
 
-void initialize() {
-    //Game Window
-    InitWindow(0, 0, "Empyral Imperium");
-    ToggleBorderlessWindowed();
-    ClearWindowState(FLAG_WINDOW_TOPMOST);
-    SetTargetFPS(60);
-    HideCursor();
+// Quicksave (F5), quickload (F9) and the autosave after every transition
+void saveGame(const std::string& path, Player& player, Map& map) {
+    TelemetryScope scope(SCOPE_SAVE);
+    double start = GetTime();
+    map.storeNpcs();
+    world.player = { world.slot(map.mapName), player.x, player.y, player.direction };
+    if (world.save(path))
+        TraceLog(LOG_INFO, "SAVE: Wrote %s in %.3f ms", path.c_str(), (GetTime() - start) * 1000.0);
+}
+
+bool loadGame(const std::string& path, Player& player, Map& map) {
+    if (!world.load(path)) return false;
+    map.loadMap(world.slotName(world.player.map), NO_NAME);
+    player.x = world.player.x;
+    player.y = world.player.y;
+    player.direction = world.player.direction;
+    player.atlas = map.addSpriteAtlas<LpcSheet>(&player.texture);
+    player.updatePlayerBody();
+    return true;
 }
 
-void input(Player &player, Map &map) {
+void input(Player &player, Map &map, Camera2D &camera) {
+    if (IsKeyPressed(KEY_F3)) {
+        toggleRewind(player, map, camera);
+        return;
+    }
+    if (gameState == STATE_REWIND) {
+        rewindInput(player, map, camera);
+        return;
+    }
+
     if (gameState == STATE_DIALOGUE) {
+        TelemetryScope scope(SCOPE_DIALOGUE, player.currentDialogue->name);
         if (IsKeyPressed(KEY_Z)) {
             if (!player.lineFinished) {
-                player.visibleChars = player.currentDialogue->msg[player.dialogueIndex].size();
+                player.visibleChars = dialogueDB.line(player.currentDialogue, player.dialogueIndex).codepointCount;
                 player.lineFinished = true;
             } else {
                 player.dialogueIndex++;
 
-                if (player.dialogueIndex >= (int)player.currentDialogue->msg.size()) {
+                if (player.dialogueIndex >= (int)player.currentDialogue->lineCount) {
                     gameState = STATE_NORMAL;
                     player.currentDialogue = nullptr;
                     if (player.currentDialogueNPC != nullptr) {
                         player.currentDialogueNPC->direction = player.currentDialogueNPC->default_direction;
                         player.currentDialogueNPC = nullptr;
                     }
+                    // Dialogue started by an event, give control back to it
+                    if (scheduler.dialogueWaiter) {
+                        gameState = STATE_EVENT;
+                        scheduler.finishDialogue();
+                    }
                 } else {
                     player.visibleChars = 0;
                     player.textTimer = 0.0f;
@@ -952,7 +5963,7 @@ void input(Player &player, Map &map) {
         }
         else if (IsKeyPressed(KEY_X)) {
             if (!player.lineFinished) {
-                player.visibleChars = player.currentDialogue->msg[player.dialogueIndex].size();
+                player.visibleChars = dialogueDB.line(player.currentDialogue, player.dialogueIndex).codepointCount;
                 player.lineFinished = true;
             }
         }
@@ -963,20 +5974,10 @@ void input(Player &player, Map &map) {
         // Object dialogues - could be rewritten to use interaction zone, not really used
         for (DialoguePoint &dp : map.dialoguePoints) {
             if (CheckCollisionRecs(player.body, dp.trigger)) {
-                for (Dialogue& dia : map.dialogues) {
-                    if (dp.src == dia.name) {
-                        gameState = STATE_DIALOGUE;
-                        player.currentDialogue = &dia;
-
-                        player.frame = 0;
-
-                        player.dialogueIndex = 0;
-                        player.visibleChars = 0;
-                        player.textTimer = 0.0f;
-                        player.lineFinished = false;
-
-                        return;
-                    }
+                const Dialogue* dia = map.findDialogue(dp.src);
+                if (dia) {
+                    startDialogue(player, dia, nullptr);
+                    return;
                 }
             }
         }
@@ -986,20 +5987,9 @@ void input(Player &player, Map &map) {
         map.debugColliders.push_back(interact);
 
         for (NPC& npc : map.npcs) {
-            if (npc.hasDialogue && CheckCollisionRecs(interact, npc.body)) {
-                gameState = STATE_DIALOGUE;
-                player.currentDialogue = &npc.dialogue;
-                player.currentDialogueNPC = &npc;
-
-                player.frame = 0;
-
+            if (npc.dialogue && CheckCollisionRecs(interact, npc.body)) {
+                startDialogue(player, npc.dialogue, &npc);
                 npc.updateDirection(player.direction);
-
-                player.dialogueIndex = 0;
-                player.visibleChars = 0;
-                player.textTimer = 0.0f;
-                player.lineFinished = false;
-
                 return;
             }
         }
@@ -1020,41 +6010,26 @@ void input(Player &player, Map &map) {
         player.lastKey = backupKey;
 
     if (IsKeyPressed(KEY_F1)) DEBUG_MODE = !DEBUG_MODE;
+    if (IsKeyPressed(KEY_F4)) SHADER_TILEMAP = !SHADER_TILEMAP;
+    if (IsKeyPressed(KEY_F6)) DYNAMIC_RESOLUTION = !DYNAMIC_RESOLUTION;
 
-    if (gameState != STATE_NORMAL) return;        // Block controls while in transition or any other irregular state
-
-    // Very basic running system
-    if (IsKeyDown(KEY_LEFT_SHIFT)) {
-        player.speed = 250.0f;
-        player.frameMaxTimer = 0.08f;
-    }
-    else {
-        player.speed = 150.0f;
-        player.frameMaxTimer = 0.10f;
+    if (gameState == STATE_NORMAL) {
+        if (IsKeyPressed(KEY_F5)) saveGame(QUICKSAVE_PATH, player, map);
+        if (IsKeyPressed(KEY_F9) && loadGame(QUICKSAVE_PATH, player, map)) return;
     }
 
-    player.updatePlayerBody();
-
-    if (dx != 0.0f) {
-        Rectangle playerCopy = player.body;
-        playerCopy.x += dx;
+    if (gameState != STATE_NORMAL) return;        // Block controls while in transition or any other irregular state
 
-        if (!map.checkCollision(playerCopy))
-            player.x += dx;
-    }
+    // Very basic running system
+    bool running = IsKeyDown(KEY_LEFT_SHIFT);
+    player.speed = running ? 250.0f : 150.0f;
 
     player.updatePlayerBody();
-
-    if (dy != 0.0f) {
-        Rectangle playerCopy = player.body;
-        playerCopy.y += dy;
-
-        if (!map.checkCollision(playerCopy))
-            player.y += dy;
-    }
-
+    Vector2 moved = map.move(player.body, { dx, dy });
+    player.x += moved.x;
+    player.y += moved.y;
     player.updatePlayerBody();
-    player.updatePlayerAnimation(GetFrameTime(), dx, dy, player.lastKey);
+    player.updatePlayerAnimation(GetFrameTime(), dx, dy, player.lastKey, running);
 
     for (Transition& t : map.transitions) {
         if (CheckCollisionRecs(player.body, t.trigger)) {
@@ -1067,232 +6042,60 @@ void input(Player &player, Map &map) {
 
     for (EventPoint& ep : map.eventPoints) {
         if (CheckCollisionRecs(player.body, ep.trigger)) {
-            for (Event& ev : map.events) {
-                if (ep.name == ev.name) {
-                    if (ev.triggered) break;
-                    player.ongoingEvent = &ev;
-                    gameState = STATE_EVENT;
-                }
-            }
-            break;
-        }
-    }
-}
-
-bool executeAction(EventAction& action, Player& player, Camera2D& camera) {
-    switch (action.type) {
-        case ACTION_DIALOGUE: {
-            return true;
-            break;
-        }
-        // case action pause + rewrite player/npc functions
-        case ACTION_MOVE_CAMERA: {
-            if (!action.started) {
-                action.started = true;
-                player.frame = 0;
-                switch (action.direction) {
-                    case RIGHT:
-                        action.target = camera.target.x + action.tiles * tileSize;
-                        break;
-                    case LEFT:
-                        action.target = camera.target.x - action.tiles * tileSize;
-                        break;
-                    case DOWN:
-                        action.target = camera.target.y + action.tiles * tileSize;
-                        break;
-                    case UP:
-                        action.target = camera.target.y - action.tiles * tileSize;
-                        break;
-                }
-            }
-
-            switch (action.direction) {
-                case RIGHT:
-                    camera.target.x = round(std::min(camera.target.x + action.speed * GetFrameTime(), action.target));
-                    if (camera.target.x == action.target) return true;
-                    break;
-                case LEFT:
-                    camera.target.x = round(std::max(camera.target.x - action.speed * GetFrameTime(), action.target));
-                    if (camera.target.x == action.target) return true;
-                    break;
-                case DOWN:
-                    camera.target.y = round(std::min(camera.target.y + action.speed * GetFrameTime(), action.target));
-                    if (camera.target.y == action.target) return true;
-                    break;
-                case UP:
-                    camera.target.y = round(std::max(camera.target.y - action.speed * GetFrameTime(), action.target));
-                    if (camera.target.y == action.target) return true;
-                    break;
-            }
-            break;
-        }
-        case ACTION_MOVE_NPC: {
-            NPC* npc = action.npc;
-            if (!action.started) {
-                action.started = true;
-                npc->direction = action.direction;
-                switch (action.direction) {
-                    case RIGHT:
-                        action.target = npc->x + action.tiles * tileSize;
-                        break;
-                    case LEFT:
-                        action.target = npc->x - action.tiles * tileSize;
-                        break;
-                    case DOWN:
-                        action.target = npc->y + action.tiles * tileSize;
-                        break;
-                    case UP:
-                        action.target = npc->y - action.tiles * tileSize;
-                        break;
-                }
-            }
-            
-            float distance = 0.0f;
-            switch (action.direction) {
-                case RIGHT:
-                case LEFT:
-                    distance = abs(action.target - npc->x);
-                    break;
-                case UP:
-                case DOWN:
-                    distance = abs(action.target - npc->y);
-                    break;
-            }
-
-            if (distance > 1.0f) {
-                switch (action.direction) {
-                    case RIGHT:
-                        npc->x += npc->speed * GetFrameTime();
-                        break;
-                    case LEFT:
-                        npc->x -= npc->speed * GetFrameTime();
-                        break;
-                    case DOWN:
-                        npc->y += npc->speed * GetFrameTime();
-                        break;
-                    case UP:
-                        npc->y -= npc->speed * GetFrameTime();
-                        break;
-                }
-                if (action.follow)
-                    camera.target = { floor(npc->x + tileSize/2.0f), floor(npc->y + tileSize/2.0f) };
-
-                npc->updateBody();
-                npc->updateFrame(GetFrameTime());
-
-            } else {
-                npc->frame = 0;
-                return true;
-            }
-            break;
-        }
-        case ACTION_MOVE_PLAYER: {
-            if (!action.started) {
-                action.started = true;
-                player.direction = action.direction;
-                switch (action.direction) {
-                    case RIGHT:
-                        action.target = player.x + action.tiles * tileSize;
-                        break;
-                    case LEFT:
-                        action.target = player.x - action.tiles * tileSize;
-                        break;
-                    case DOWN:
-                        action.target = player.y + action.tiles * tileSize;
-                        break;
-                    case UP:
-                        action.target = player.y - action.tiles * tileSize;
-                        break;
-                }
-                player.speed = 150.0f;
-                player.frameMaxTimer = 0.10f;
-            }
-            
-            float distance = 0.0f;
-            switch (action.direction) {
-                case RIGHT:
-                case LEFT:
-                    distance = abs(action.target - player.x);
-                    break;
-                case UP:
-                case DOWN:
-                    distance = abs(action.target - player.y);
-                    break;
-            }
-
-            if (distance > 1.0f) {
-                switch (action.direction) {
-                    case RIGHT:
-                        player.x += player.speed * GetFrameTime();
-                        break;
-                    case LEFT:
-                        player.x -= player.speed * GetFrameTime();
-                        break;
-                    case DOWN:
-                        player.y += player.speed * GetFrameTime();
-                        break;
-                    case UP:
-                        player.y -= player.speed * GetFrameTime();
-                        break;
-                }
-
-                if (action.follow)
-                    camera.target = { floor(player.x + tileSize/2.0f), floor(player.y + tileSize/2.0f) };
-
-                player.updatePlayerBody();
-                player.updatePlayerFrame(GetFrameTime());
-
-            } else return true;
-            break;
-        }
-        case ACTION_GROUP: {
-            bool allFinished = true;
-            for (EventAction& sub : action.subactions) {
-                if (!sub.finished) {
-                    bool done = executeAction(sub, player, camera);
-                    if (!done)
-                        allFinished = false;
-                    else
-                        sub.finished = true;
-                }
+            Event* ev = map.findEvent(ep.name);
+            if (ev && !ev->triggered) {
+                player.ongoingEvent = ev;
+                gameState = STATE_EVENT;
+                MemoryScope scope(MEM_SCRIPTS);      // Coroutine frames
+                scheduler.start(runEvent(*ev, player, map, camera));
             }
-            if (allFinished) return true;
             break;
         }
     }
-    return false;
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
     //Initialize
+    settings.load(CONFIG_PATH);
+    settings.parseArgs(argc, argv);
     initialize();
 
     //Texture Renderer (screen scaling)
-    RenderTexture2D target = LoadRenderTexture(GAME_WIDTH, GAME_HEIGHT);
+    ResolutionScaler resolution;
+    resolution.init(GetScreenWidth(), GetScreenHeight());
 
     Player player = Player();
     Camera2D camera = setupCamera(player);
 
+    dialogueDB.load(DEFAULT_LANGUAGE);
+
     Map map = Map();
-    map.loadMap("mapa_dungeon", "player_1");
+    map.loadMap(intern("mapa_dungeon"), intern("player_1"));
     player.x = map.playerSpawn.x;
     player.y = map.playerSpawn.y;
+    player.atlas = map.addSpriteAtlas<LpcSheet>(&player.texture);
 
     camera.target.x = floor(camera.target.x);
     camera.target.y = floor(camera.target.y);
 
-    Drawable playerDraw;
-    playerDraw.texture = &player.texture;
-
     Image textboxImage = LoadImage((RESOURCE_PATH + "textbox.png").c_str());
-    Texture2D textboxTexture = LoadTextureFromImage(textboxImage);
+    Texture2D textboxTexture = loadTextureFromImage(textboxImage, VRAM_UI);
     UnloadImage(textboxImage);
 
+    FileWatcher watcher;
+    watcher.start(RESOURCE_PATH);
+
+    history.configure(REWIND_SECONDS, settings.tickRate, REWIND_BUDGET);
+    double budgetCheck = 0.0;
+
     while (!WindowShouldClose())
     {
+        double frameStart = GetTime();
+        GameState frameState = gameState;           // Telemetry charges the frame to the state it started in
+
         //Input
-        input(player, map);
+        input(player, map, camera);
 
         // Transitions
         if (gameState == STATE_TRANSITION) {
@@ -1301,10 +6104,13 @@ int main(void)
                 if (player.fadeAlpha >= 1.0f) {
                     player.fadeAlpha = 1.0f;
 
+                    map.storeNpcs();
                     map.loadMap(player.pendingTransition->map, player.pendingTransition->spawnName);
                     player.x = map.playerSpawn.x;
                     player.y = map.playerSpawn.y;
+                    player.atlas = map.addSpriteAtlas<LpcSheet>(&player.texture);
                     player.updatePlayerBody();
+                    saveGame(AUTOSAVE_PATH, player, map);
 
                     player.fading = false;
                 }
@@ -1318,108 +6124,112 @@ int main(void)
             }
         }
 
+        // Hot reload of the current map files
+        for (const std::string& file : watcher.poll())
+            map.queueReload(file);
+        map.applyReloads(player);
+
+        // Memory budgets, map loads check right away
+        if (GetTime() - budgetCheck >= 1.0) {
+            budgetCheck = GetTime();
+            memoryBudgets.checkAll();
+        }
+
         //Camera update
-        if (gameState != STATE_EVENT)
+        if (!player.ongoingEvent && gameState != STATE_REWIND)
             camera.target = { floor(player.x + tileSize/2.0f), floor(player.y + tileSize/2.0f) };       //Floored to avoid visual bugs, player must also be floored
+
+        map.updateStreaming(camera.target);
+
+        // NPC behaviours, paused during events, dialogues and rewinds
+        npcScheduler.classify(map, camera);
+        map.npcSprites.update(map.npcs, cameraView(camera), GetFrameTime());
+        if (gameState == STATE_NORMAL && !player.ongoingEvent) {
+            TelemetryScope scope(SCOPE_NPCS);
+            npcScheduler.update(map, player, GetFrameTime());
+        }
+
+        // Particles are only visual, frozen while rewinding
+        if (gameState != STATE_REWIND) {
+            TelemetryScope scope(SCOPE_PARTICLES);
+            map.particles.update(GetFrameTime(), cameraView(camera));
+        }
         
-        // Events
-        if (gameState == STATE_EVENT) {
-            Event* ev = player.ongoingEvent;
-            if (!ev) {
+        // Events, also ticked while an event dialogue is open so grouped moves keep going
+        if (player.ongoingEvent && gameState != STATE_REWIND) {
+            double eventStart = GetTime();
+            MemoryScope scope(MEM_SCRIPTS);
+            scheduler.tick(GetFrameTime());
+            telemetry.add(SCOPE_EVENT, player.ongoingEvent->name, GetTime() - eventStart);
+            if (!scheduler.running()) {
                 gameState = STATE_NORMAL;
-            }
-            else if (ev->eventIndex >= (int) ev->actions.size()) {
-                gameState = STATE_NORMAL;
-                ev->eventIndex = 0;
-                ev->triggered = true;
+                map.finishEvent(*player.ongoingEvent);
                 player.ongoingEvent = nullptr;
-            }
-            else {
-                EventAction& action = ev->actions[ev->eventIndex];
-                if (executeAction(action, player, camera)) ev->eventIndex++;
+                scheduler.clear();
             }
         }
 
+        // Rewind history, one snapshot per tick of play
+        if (gameState != STATE_REWIND && gameState != STATE_TRANSITION && history.tickDue(GetFrameTime())) {
+            MemoryScope scope(MEM_REWIND);
+            captureTick(rewindTick, player, map, camera);
+            history.push(rewindTick, map.mapName);
+        }
+
+        // Light buffer, before the scene since texture modes can't nest
+        map.lighting.render(camera, map.lights, { player.body.x + player.body.width/2.0f, player.body.y }, map.torchRadius);
+
         //Draw
-        BeginTextureMode(target);
+        // Dialogue drawn inside the window is charged to its own scope, not to render as well
+        double renderStart = GetTime();
+        float nestedStart = telemetry.scopeTime[SCOPE_DIALOGUE];
+        BeginTextureMode(resolution.target);
 
-        ClearBackground(BLUE);
+        ClearBackground(map.background);
 
-        BeginMode2D(camera);
+        BeginMode2D(resolution.worldCamera(camera));
         
         TileLayer above;
 
-        // Draw map
+        // Draw map, parallax backgrounds first
+        map.parallax.draw(cameraView(camera), camera.target, false);
         map.drawMap(true);
 
         // Draw player and other drawables
         map.dynamicDrawables.clear();
 
         // Player
-        Rectangle src = { player.frame * player.spriteW, 
-                        player.direction * player.spriteH, 
-                        player.spriteW, 
-                        player.spriteH };
-
-        Rectangle dst = { floor(player.x), 
-                        floor(player.y) - (player.spriteH - tileSize), 
-                        player.spriteW, 
-                        player.spriteH };         //Floored to avoid visual bugs, cam must also be floored
-
-        playerDraw.src = src;
-        playerDraw.dst = dst;
-        playerDraw.sortY = player.body.y + player.body.height;
-
-        map.dynamicDrawables.push_back(playerDraw);
+        map.pushDynamic(floor(player.x),
+                        floor(player.y) - (player.spriteH - tileSize),         //Floored to avoid visual bugs, cam must also be floored
+                        player.body.y + player.body.height,
+                        player.atlas,
+                        LpcSheet::cell(player.clip, player.direction, player.frame));
 
         // NPCs
-        for (NPC& npc : map.npcs) {
-            Drawable d;
-            d.texture = &npc.texture;
-
-            d.src = {
-                npc.frame * npc.spriteW,
-                npc.direction * npc.spriteH,
-                npc.spriteW,
-                npc.spriteH
-            };
-
-            d.dst = {
-                floor(npc.x),
-                floor(npc.y) - (npc.spriteH - tileSize),
-                npc.spriteW,
-                npc.spriteH
-            };
-
-            d.sortY = npc.body.y + npc.body.height;
-
-            map.dynamicDrawables.push_back(d);
-        }
+        for (NPC& npc : map.npcs)
+            if (npc.visible)
+                map.pushDynamic(floor(npc.x),
+                                floor(npc.y) - (npc.spriteH - tileSize),
+                                npc.body.y + npc.body.height,
+                                npc.texture.id ? npc.atlas : map.placeholderAtlas,
+                                npc.texture.id ? LpcSheet::cell(npc.clip, npc.direction, npc.frame) : 0);
 
         // Map drawables
-        std::vector<Drawable*> drawables;
-        drawables.reserve(map.staticDrawables.size() + map.dynamicDrawables.size());
-
-        for (Drawable& d : map.staticDrawables)
-            drawables.push_back(&d);
-
-        for (Drawable& d : map.dynamicDrawables)
-            drawables.push_back(&d);
-
-        std::sort(drawables.begin(), drawables.end(),
-            [](Drawable* a, Drawable* b) {
-                return a->sortY < b->sortY;
-            }
-        );
-
-        for (Drawable* d : drawables) {
-            DrawTexturePro(*d->texture, d->src, d->dst, {0,0}, 0, WHITE);
-        }
-
-        drawables.clear();
+        map.drawDrawables();
+        map.particles.draw(cameraView(camera));
 
         // Draw topmost layer
         map.drawMap(false);
+        map.parallax.draw(cameraView(camera), camera.target, true);
+
+        // Lighting, multiplied over everything drawn so far
+        if (map.lighting.enabled) {
+            EndMode2D();
+            BeginMode2D(resolution.uiCamera());
+            map.lighting.composite();
+            EndMode2D();
+            BeginMode2D(resolution.worldCamera(camera));
+        }
 
         // Draw debug info
         if (DEBUG_MODE) {
@@ -1452,9 +6262,42 @@ int main(void)
         
         EndMode2D();
 
+        // Everything below is in GAME_WIDTH x GAME_HEIGHT units whatever the internal resolution
+        BeginMode2D(resolution.uiCamera());
+
+        // Memory, current and peak of every category in use
+        if (DEBUG_MODE) {
+            int y = 20;
+            if (MEMORY_TRACKED)
+                DrawText(TextFormat("CPU %.1f MiB (peak %.1f)  VRAM %.1f MiB (peak %.1f)", memoryTotal.current / 1048576.0, memoryTotal.peak / 1048576.0,
+                    vram.total / 1048576.0, vram.totalPeak / 1048576.0), GAME_WIDTH - 520, y, 16, LIME);
+            else DrawText(TextFormat("VRAM %.1f MiB (peak %.1f)", vram.total / 1048576.0, vram.totalPeak / 1048576.0), GAME_WIDTH - 520, y, 16, LIME);
+            for (int c = 0; c < MEM_CATEGORY_COUNT; c++)
+                if (memoryCounters[c].peak > 0)
+                    DrawText(TextFormat("%-10s %8.2f / %8.2f", MEMORY_NAMES[c], memoryCounters[c].current / 1048576.0, memoryCounters[c].peak / 1048576.0),
+                        GAME_WIDTH - 520, y += 18, 16, LIME);
+            for (int c = 0; c < VRAM_CATEGORY_COUNT; c++)
+                if (vram.peak[c] > 0)
+                    DrawText(TextFormat("vram %-10s %8.2f / %8.2f", VRAM_NAMES[c], vram.current[c] / 1048576.0, vram.peak[c] / 1048576.0),
+                        GAME_WIDTH - 520, y += 18, 16, SKYBLUE);
+        }
+
+        if (DEBUG_MODE)
+            DrawText(TextFormat("Pacing %s %.0f Hz  frame %.2f ms  jitter %.2f ms  worst %.2f ms", PACING_NAMES[pacer.mode], 1.0 / pacer.interval,
+                pacer.mean * 1000.0, pacer.jitter * 1000.0, pacer.worst * 1000.0), 20, GAME_HEIGHT - 80, 20, LIME);
+        if (DEBUG_MODE)
+            DrawText(TextFormat("Resolution %dx%d (%.2fx)%s", resolution.target.texture.width, resolution.target.texture.height,
+                resolution.scale(), DYNAMIC_RESOLUTION ? "" : " fixed"), 20, GAME_HEIGHT - 55, 20, LIME);
+        if (DEBUG_MODE)
+            DrawText(TextFormat("NPC near %d far %d frozen %d caught up %d  sheets %d", npcScheduler.nearCount, npcScheduler.farCount,
+                npcScheduler.frozenCount, npcScheduler.caughtUp, map.npcSprites.loadedCount), 20, GAME_HEIGHT - 30, 20, LIME);
+
+        if (gameState == STATE_REWIND)
+            DrawText(TextFormat("REWIND  %.2f s", (history.cursor + 1.0f - history.end) / settings.tickRate), 20, 20, 20, RED);
+
         // Draw dialogues
         if (gameState == STATE_DIALOGUE && player.currentDialogue) {
-            const std::string& text = player.currentDialogue->msg[player.dialogueIndex];
+            int length = dialogueDB.line(player.currentDialogue, player.dialogueIndex).codepointCount;
 
             if (!player.lineFinished) {
                 player.textTimer += GetFrameTime();
@@ -1462,8 +6305,8 @@ int main(void)
                     player.textTimer = 0.0f;
                     player.visibleChars++;
 
-                    if (player.visibleChars >= (int)text.size()) {
-                        player.visibleChars = text.size();
+                    if (player.visibleChars >= length) {
+                        player.visibleChars = length;
                         player.lineFinished = true;
                     }
                 }
@@ -1471,6 +6314,7 @@ int main(void)
         }
         
         if (gameState == STATE_DIALOGUE) {
+            TelemetryScope scope(SCOPE_DIALOGUE, player.currentDialogue ? player.currentDialogue->name : NO_NAME);
             Rectangle outer = { 300, GAME_HEIGHT - 180, GAME_WIDTH - 600, 140 };
             Rectangle inner = { 306, GAME_HEIGHT - 174, GAME_WIDTH - 612, 128 };
 
@@ -1482,26 +6326,24 @@ int main(void)
             Rectangle src = {0, 0, (float)textboxTexture.width, (float)textboxTexture.height};
             DrawTexturePro(textboxTexture, src, outer, {0,0}, 0, Color {255, 255, 255, 255});
 
-            Dialogue* d = player.currentDialogue;
-            int i = player.dialogueIndex;
-
-            std::string speaker = d->speaker[i];
-            std::string fullText = d->msg[i];
-            std::string visibleText = fullText.substr(0, player.visibleChars);
+            // Straight from the dialogue table, the typewriter prefix is just a shorter codepoint count
+            const DialogueLine& line = dialogueDB.line(player.currentDialogue, player.dialogueIndex);
 
             DrawText(
-                speaker.c_str(),
+                dialogueDB.speaker(line),
                 inner.x + 10,
                 inner.y + 8,
                 20,
                 Color {255, 255, 255, 255}
             );
 
-            DrawText(
-                visibleText.c_str(),
-                inner.x + 10,
-                inner.y + 46,
+            DrawTextCodepoints(
+                GetFontDefault(),
+                dialogueDB.msgCodepoints(line),
+                player.visibleChars,
+                { inner.x + 10, inner.y + 46 },
                 20,
+                2,                              // Same spacing DrawText uses at size 20
                 Color {62, 31, 29, 255}
             );
 
@@ -1516,16 +6358,26 @@ int main(void)
             }
         }
 
+        EndMode2D();
         EndTextureMode();
         
         BeginDrawing();
 
-        DrawTexturePro(target.texture, Rectangle{ 0, 0, (float)target.texture.width, -(float)target.texture.height }, 
-        Rectangle{ 0, 0, (float)GetScreenWidth(), (float)GetScreenHeight() }, Vector2{0,0}, 0, WHITE ); 
+        resolution.present();
+        double renderEnd = GetTime();
+        double workTime = renderEnd - frameStart;
+        telemetry.add(SCOPE_RENDER, NO_NAME, renderEnd - renderStart - (telemetry.scopeTime[SCOPE_DIALOGUE] - nestedStart));
+
+        EndDrawing();                       // Swap wait under vsync lands in "other", not render
+        pacer.wait();
+        telemetry.endFrame(frameState, pacer.last, pacer.interval);
 
-        EndDrawing();
+        resolution.update(workTime, GetFrameTime(), pacer.interval);
     }
 
+    telemetry.writeSummary(TELEMETRY_PATH);
+    if (settings.memoryReport)
+        std::cout << memoryReport();
     CloseWindow();
 
     return 0;